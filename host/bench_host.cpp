@@ -0,0 +1,153 @@
+// Host build of the /bench kernel benchmark: runs runKernelBenchmarks() from
+// src/main.cpp and compares each case's minimum with a baseline file, using
+// the device's per-kernel tolerances and noise floor. A tolerance argument
+// overrides the detector kernels' tolerance like /control benchTolerance;
+// a desktop's frequency scaling and scheduler need more than 10%. A failing
+// check is run again, up to BENCH_HOST_RUNS times, and compared with the best
+// minimum of all runs, so a regression has to show in every run; the
+// baseline is recorded as the best of BENCH_HOST_RUNS runs.
+//
+//   bench_host <baseline> [tolerance]   exit 1 on a regression
+//   bench_host <baseline> --save        write the run as the new baseline
+//
+// Baseline lines: kernel width height dataset min median (counter ticks).
+// Ticks are machine specific; keep the committed baseline from the machine
+// that runs the gate. The JPEG encoder is a stub on the host, so jpegEncode
+// is left out of the baseline and the check.
+#include "../src/main.cpp"
+#include <stdio.h>
+
+#define BENCH_HOST_RUNS 3
+
+static BenchTable benchBest;
+
+// fmt2jpg is a stub that fails at once; there is nothing to time
+static bool measuredOnHost(int k) {
+  return k != BENCH_JPEG;
+}
+
+// Fold the last run into benchBest (per-case minimum over runs)
+static void keepBestRun(bool first) {
+  for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+    for (int s = 0; s < BENCH_SIZE_COUNT; s++) {
+      for (int d = 0; d < BENCH_DATASET_COUNT; d++) {
+        BenchResult& best = benchBest[k][s][d];
+        const BenchResult& result = benchResults[k][s][d];
+        if (first || result.minTicks < best.minTicks) best = result;
+      }
+    }
+  }
+  memcpy(benchResults, benchBest, sizeof(benchResults));
+}
+
+static bool loadBaseline(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return false;
+  char line[160];
+  char unit[16] = "";
+  while (fgets(line, sizeof(line), file)) {
+    if (sscanf(line, "# unit %15s", unit) == 1) continue;
+    if (line[0] == '#' || line[0] == '\n') continue;
+    char kernel[48], dataset[16];
+    unsigned width, height;
+    unsigned long minTicks, medianTicks;
+    if (sscanf(line, "%47s %u %u %15s %lu %lu", kernel, &width, &height, dataset, &minTicks, &medianTicks) != 6) continue;
+    for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+      if (!measuredOnHost(k)) continue;
+      for (int s = 0; s < BENCH_SIZE_COUNT; s++) {
+        for (int d = 0; d < BENCH_DATASET_COUNT; d++) {
+          if (strcmp(kernel, benchKernelNames[k]) == 0 && strcmp(dataset, benchDatasetNames[d]) == 0 &&
+              width == benchSizes[s][0] && height == benchSizes[s][1]) {
+            benchBaseline[k][s][d].minTicks = minTicks;
+            benchBaseline[k][s][d].medianTicks = medianTicks;
+          }
+        }
+      }
+    }
+  }
+  fclose(file);
+  if (strcmp(unit, PROFILE_UNIT) != 0) {
+    fprintf(stderr, "%s: baseline unit '%s', this build counts '%s'\n", path, unit, PROFILE_UNIT);
+    return false;
+  }
+  benchHaveBaseline = true;
+  return true;
+}
+
+static bool saveBaseline(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == NULL) return false;
+  fprintf(file, "# Host kernel benchmark baseline (make -C host bench-baseline)\n");
+  fprintf(file, "# unit %s\n", PROFILE_UNIT);
+  for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+    if (!measuredOnHost(k)) continue;
+    for (int s = 0; s < BENCH_SIZE_COUNT; s++) {
+      for (int d = 0; d < BENCH_DATASET_COUNT; d++) {
+        const BenchResult& result = benchResults[k][s][d];
+        fprintf(file, "%s %u %u %s %lu %lu\n", benchKernelNames[k], benchSizes[s][0], benchSizes[s][1],
+                benchDatasetNames[d], (unsigned long)result.minTicks, (unsigned long)result.medianTicks);
+      }
+    }
+  }
+  return fclose(file) == 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <baseline> [tolerance | --save]\n", argv[0]);
+    return 2;
+  }
+  initTemporalFilter();  // Allocated by setup() on the device
+  initColorDetection();
+  bool save = argc > 2 && strcmp(argv[2], "--save") == 0;
+  if (argc > 2 && !save) {
+    for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+      if (measuredOnHost(k)) benchTolerancePct[k] = constrain(atoi(argv[2]), 0, 200);
+    }
+  }
+  if (save) {
+    for (int run = 0; run < BENCH_HOST_RUNS; run++) {
+      if (!runKernelBenchmarks()) {
+        fprintf(stderr, "benchmark buffers could not be allocated\n");
+        return 2;
+      }
+      keepBestRun(run == 0);
+    }
+    if (!saveBaseline(argv[1])) {
+      fprintf(stderr, "%s: cannot write\n", argv[1]);
+      return 2;
+    }
+    printf("baseline written to %s\n", argv[1]);
+    return 0;
+  }
+  if (!loadBaseline(argv[1])) return 2;
+  for (int run = 0; run < BENCH_HOST_RUNS; run++) {
+    if (!runKernelBenchmarks()) {
+      fprintf(stderr, "benchmark buffers could not be allocated\n");
+      return 2;
+    }
+    keepBestRun(run == 0);
+    if (benchPassed()) break;
+  }
+
+  int regressions = 0;
+  for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+    if (!measuredOnHost(k)) {
+      printf("%-38s not measured (encoder stubbed on the host)\n", benchKernelNames[k]);
+      continue;
+    }
+    for (int s = 0; s < BENCH_SIZE_COUNT; s++) {
+      for (int d = 0; d < BENCH_DATASET_COUNT; d++) {
+        uint32_t baseline = benchBaseline[k][s][d].minTicks;
+        uint32_t minTicks = benchResults[k][s][d].minTicks;
+        bool regressed = benchRegressed(k, s, d);
+        if (regressed) regressions++;
+        printf("%-38s %3ux%-3u %-8s min %8lu  baseline %8lu  %s\n", benchKernelNames[k], benchSizes[s][0],
+               benchSizes[s][1], benchDatasetNames[d], (unsigned long)minTicks, (unsigned long)baseline,
+               regressed ? "REGRESSED" : "ok");
+      }
+    }
+  }
+  printf("%s (%d regressed)\n", benchPassed() ? "pass" : "FAIL", regressions);
+  return benchPassed() ? 0 : 1;
+}
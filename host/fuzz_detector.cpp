@@ -0,0 +1,259 @@
+// Fuzz target for the detector: one input is one frame plus the settings it
+// is processed with, run through the same steps as /stream and then through
+// planScanlines and analyzeScanline on rows in and around the frame.
+//
+// Input layout (little endian):
+//   0-1  width  (1 + value % 400)     4  flags: invert, glare, lane, adaptive,
+//   2-3  height (1 + value % 300)           learning, bridging, tracer, boundary
+//   5    binary threshold             6  pyramid (bits 0-1), morph (2-3), temporal (4-5)
+//   7    commanded speed              8+ grayscale pixels, repeated to fill the frame
+//
+// Built with -fsanitize=fuzzer this is a libFuzzer target; with
+// -DFUZZ_STANDALONE it gets a main() that runs the files named on the command
+// line (the seed corpus, crash reproducers, or AFL's @@). Without clang,
+// "-mutate=SECONDS" makes the standalone build mutate those files for that
+// long; each mutated input is written to fuzz-input before it runs, so the
+// file left behind by a sanitizer abort reproduces it.
+//
+// The standalone build also takes /frame.pgm captures (device frames, the
+// rendered scenes in golden/rendered/) as inputs: the PGM becomes the pixels,
+// with the device's default settings and the comment's threshold and line
+// color. "-convert=DIR" writes them to DIR in the input layout, as seeds for
+// libFuzzer or for fuzz/corpus.
+#include "../src/main.cpp"
+#include <stdio.h>
+#include <time.h>
+
+#define FUZZ_HEADER_BYTES 8
+#define FUZZ_MAX_WIDTH 400   // Beyond the camera's 320x240 to reach the size guards
+#define FUZZ_MAX_HEIGHT 300
+
+static uint8_t fuzzFrame[FUZZ_MAX_WIDTH * FUZZ_MAX_HEIGHT];
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (size < FUZZ_HEADER_BYTES) return 0;
+  size_t width = 1 + (data[0] | (data[1] << 8)) % FUZZ_MAX_WIDTH;
+  size_t height = 1 + (data[2] | (data[3] << 8)) % FUZZ_MAX_HEIGHT;
+  uint8_t flags = data[4];
+  invertColors = flags & 0x01;
+  glareMaskEnabled = flags & 0x02;
+  laneModeEnabled = flags & 0x04;
+  adaptiveScanlinesEnabled = flags & 0x08;
+  lineWidthLearningEnabled = flags & 0x10;
+  gapBridgingEnabled = flags & 0x20;
+  lineTracerEnabled = flags & 0x40;
+  boundaryMonitorEnabled = flags & 0x80;
+  binaryThreshold = data[5];
+  static const int pyramidFactors[4] = {0, 2, 4, 4};
+  static const int temporalFrames[4] = {0, 3, 5, 0};
+  pyramidFactor = pyramidFactors[data[6] & 3];
+  morphFilter = (data[6] >> 2) & 3;
+  temporalFilterFrames = temporalFrames[(data[6] >> 4) & 3];
+  commandedSpeed = data[7];
+
+  const uint8_t* pixels = data + FUZZ_HEADER_BYTES;
+  size_t pixelCount = size - FUZZ_HEADER_BYTES;
+  for (size_t i = 0; i < width * height; i++) {
+    fuzzFrame[i] = pixelCount > 0 ? pixels[i % pixelCount] : 0;
+  }
+
+  // Every input starts like the first frame after boot, so a crash
+  // reproduces from its own file
+  clearDetectorHistory();
+  resetTemporalFilter();
+
+  frameSequence++;
+  ensureFrameArena(width, height);
+  resetFrameArena();
+  measureScanlineContrast(fuzzFrame, width, height);
+  if (boundaryMonitorEnabled) monitorFieldBoundary(fuzzFrame, width, height);
+  if (!stageScanlineRows(fuzzFrame, width, height)) {
+    selectDetectorPipeline()->binarize(fuzzFrame, width, height);
+    applyBinaryFilters(fuzzFrame, width, height);
+  }
+  detectLineCenter(fuzzFrame, width, height);
+  finishBinarization();
+  pathToJson();
+
+  planScanlines(width, height);
+  const int rows[6] = {-1, 0, (int)height / 2, (int)height - 1, (int)height, (int)height + 7};
+  for (int i = 0; i < 6; i++) {
+    analyzeScanline(fuzzFrame, width, height, rows[i]);
+  }
+  return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+#define FUZZ_INPUT_SIZE (FUZZ_HEADER_BYTES + FUZZ_MAX_WIDTH * FUZZ_MAX_HEIGHT)
+
+static uint8_t input[FUZZ_INPUT_SIZE];
+static uint8_t mutated[FUZZ_INPUT_SIZE];
+static size_t mutatedSize = 0;
+static uint32_t mutateState = 0x9e3779b9;
+
+static uint32_t mutateRandom() {
+  mutateState ^= mutateState << 13;
+  mutateState ^= mutateState >> 17;
+  mutateState ^= mutateState << 5;
+  return mutateState;
+}
+
+// A sanitizer aborts without unwinding, so the input goes to disk first
+static bool saveMutatedInput() {
+  FILE* file = fopen("fuzz-input", "wb");
+  if (file == NULL) return false;
+  fwrite(mutated, 1, mutatedSize, file);
+  return fclose(file) == 0;
+}
+
+// Byte flips, header rewrites, inserted runs and truncation of a seed
+static void mutateInput(size_t size) {
+  memcpy(mutated, input, size);
+  mutatedSize = size;
+  int edits = 1 + mutateRandom() % 8;
+  for (int e = 0; e < edits; e++) {
+    uint32_t r = mutateRandom();
+    switch (r % 5) {
+      case 0:  // Header byte: size and settings
+        if (mutatedSize >= FUZZ_HEADER_BYTES) mutated[mutateRandom() % FUZZ_HEADER_BYTES] = mutateRandom();
+        break;
+      case 1:  // Pixel flip
+        if (mutatedSize > 0) mutated[mutateRandom() % mutatedSize] ^= 1 << (mutateRandom() % 8);
+        break;
+      case 2: {  // Run of one value (edges, stripes)
+        if (mutatedSize <= FUZZ_HEADER_BYTES) break;
+        size_t start = FUZZ_HEADER_BYTES + mutateRandom() % (mutatedSize - FUZZ_HEADER_BYTES);
+        size_t length = std::min((size_t)(1 + mutateRandom() % 64), mutatedSize - start);
+        memset(mutated + start, (mutateRandom() & 1) ? 255 : 0, length);
+        break;
+      }
+      case 3:  // Truncate
+        mutatedSize = mutateRandom() % (mutatedSize + 1);
+        break;
+      default:  // Grow with random pixels
+        while (mutatedSize < FUZZ_INPUT_SIZE && (mutateRandom() & 63) != 0) mutated[mutatedSize++] = mutateRandom();
+        break;
+    }
+  }
+}
+
+// Rewrites a /frame.pgm held in input as a fuzz input in place; 0 when it
+// is not one. Settings are the device defaults: learning, tracer and
+// boundary monitor on, pyramid factor 4, no filters, speed 0.
+static size_t inputFromPgm(size_t size) {
+  int threshold = 128, invert = 0;
+  int values[5];  // Width, height, maxval (plus room for a line holding all three)
+  int count = 0;
+  size_t pos = 3;  // After "P5\n"
+  while (count < 3 && pos < size) {
+    const uint8_t* end = (const uint8_t*)memchr(input + pos, '\n', size - pos);
+    if (end == NULL) return 0;
+    char line[128];
+    size_t length = std::min((size_t)(end - input) - pos, sizeof(line) - 1);
+    memcpy(line, input + pos, length);
+    line[length] = '\0';
+    if (line[0] == '#') {
+      sscanf(line, "# threshold=%d invert=%d", &threshold, &invert);
+    } else {
+      count += sscanf(line, "%d %d %d", &values[count], &values[count + 1], &values[count + 2]);
+    }
+    pos = end - input + 1;
+  }
+  if (count != 3 || values[2] != 255 || values[0] < 1 || values[1] < 1 ||
+      values[0] > FUZZ_MAX_WIDTH || values[1] > FUZZ_MAX_HEIGHT) {
+    return 0;
+  }
+  size_t pixelCount = size - pos;
+  memmove(input + FUZZ_HEADER_BYTES, input + pos, pixelCount);
+  input[0] = (values[0] - 1) & 0xff;
+  input[1] = (values[0] - 1) >> 8;
+  input[2] = (values[1] - 1) & 0xff;
+  input[3] = (values[1] - 1) >> 8;
+  input[4] = (invert ? 0x01 : 0) | 0x10 | 0x40 | 0x80;
+  input[5] = constrain(threshold, 0, 255);
+  input[6] = 2;  // Pyramid factor 4
+  input[7] = 0;
+  return FUZZ_HEADER_BYTES + pixelCount;
+}
+
+static size_t readInput(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "%s: cannot open\n", path);
+    exit(2);
+  }
+  size_t size = fread(input, 1, sizeof(input), file);
+  fclose(file);
+  if (size >= 3 && memcmp(input, "P5\n", 3) == 0) {
+    size = inputFromPgm(size);
+    if (size == 0) {
+      fprintf(stderr, "%s: not a /frame.pgm capture\n", path);
+      exit(2);
+    }
+  }
+  return size;
+}
+
+// Each file as DIR/<name without .pgm>
+static int convertInputs(const char* dir, int count, char** paths) {
+  for (int i = 0; i < count; i++) {
+    size_t size = readInput(paths[i]);
+    const char* base = strrchr(paths[i], '/');
+    base = base ? base + 1 : paths[i];
+    char out[512];
+    snprintf(out, sizeof(out), "%s/%.*s", dir, (int)strcspn(base, "."), base);
+    FILE* file = fopen(out, "wb");
+    bool ok = file != NULL && fwrite(input, 1, size, file) == size;
+    if (file != NULL) ok = fclose(file) == 0 && ok;
+    if (!ok) {
+      fprintf(stderr, "%s: cannot write\n", out);
+      return 2;
+    }
+  }
+  printf("%d inputs written to %s\n", count, dir);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  initTemporalFilter();
+  initColorDetection();
+  int seconds = 0;
+  int first = 1;
+  if (argc > 1 && strncmp(argv[1], "-convert=", 9) == 0) return convertInputs(argv[1] + 9, argc - 2, argv + 2);
+  if (argc > 1 && sscanf(argv[1], "-mutate=%d", &seconds) == 1) first = 2;
+  if (seconds <= 0) {
+    for (int i = first; i < argc; i++) {
+      size_t size = readInput(argv[i]);
+      LLVMFuzzerTestOneInput(input, size);
+    }
+    printf("%d inputs ok\n", argc - first);
+    return 0;
+  }
+
+  if (first >= argc) {
+    fprintf(stderr, "-mutate needs seed files\n");
+    return 2;
+  }
+  time_t end = time(NULL) + seconds;
+  unsigned long runs = 0;
+  while (time(NULL) < end) {
+    size_t size = readInput(argv[first + mutateRandom() % (argc - first)]);
+    mutateInput(size);
+    if (!saveMutatedInput()) {
+      fprintf(stderr, "fuzz-input: cannot write\n");
+      return 2;
+    }
+    LLVMFuzzerTestOneInput(mutated, mutatedSize);
+    runs++;
+  }
+  remove("fuzz-input");
+  printf("%lu mutated inputs ok in %d s\n", runs, seconds);
+  return 0;
+}
+#else
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+  initTemporalFilter();
+  initColorDetection();
+  return 0;
+}
+#endif
@@ -0,0 +1,292 @@
+// Golden-output replay of frames in the /frame.pgm format (rendered scenes in
+// golden/rendered/, or captures from a device): runs each PGM through the same
+// steps as /stream and compares the detector outputs with the approved file,
+// field by field with the /golden tolerances.
+//
+//   replay_frames <approved> <frame.pgm>...             exit 1 on a mismatch
+//   replay_frames <approved> --approve <frame.pgm>...   write the outputs as approved
+//   replay_frames --sequence <frame.pgm>...             jitter and dropout report
+//   replay_frames --trace <file> <any of the above>     also write the region
+//                                                       timeline as /trace JSON
+//
+// Each frame starts from a cleared detector state with the bench's pinned
+// settings, except the threshold and line color from the PGM comment.
+// Approved lines: name centers[4] states[4] angle-x100 turn corner.
+//
+// A sequence is replayed in order with the state carried from frame to
+// frame, once per filter configuration (temporal majority, gap bridging),
+// and the frame-to-frame movement of lineCenterX and the frames without a
+// measured line are reported side by side.
+//
+// --trace needs a -DLINE_TRACE=1 build (the Makefile builds replay_frames
+// that way): the PROFILE_REGION events of the whole run are written in the
+// Chrome trace_event format of /trace, for chrome://tracing or Perfetto.
+#include "../src/main.cpp"
+#include <stdio.h>
+#include <math.h>
+
+#define REPLAY_MAX_FRAMES 256
+
+static uint8_t replayFrame[PACKED_MAX_WIDTH * MAX_FRAME_ROWS];
+
+struct ReplayEntry {
+  char name[64];
+  DetectionSnapshot snapshot;
+};
+
+// Frame name: file name without directory and extension
+static void frameName(const char* path, char* name, size_t size) {
+  const char* base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  snprintf(name, size, "%s", base);
+  char* dot = strrchr(name, '.');
+  if (dot != NULL) *dot = '\0';
+}
+
+// Binary PGM as written by /frame.pgm; threshold and invert come from the
+// "# threshold=N invert=M" comment when present
+static bool readPgm(const char* path, size_t* width, size_t* height) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) return false;
+  char line[128];
+  int values[5];  // Width, height, maxval (plus room for a line holding all three)
+  int count = 0;
+  bool ok = fgets(line, sizeof(line), file) && strncmp(line, "P5", 2) == 0;
+  while (ok && count < 3 && fgets(line, sizeof(line), file)) {
+    if (line[0] == '#') {
+      int threshold, invert;
+      if (sscanf(line, "# threshold=%d invert=%d", &threshold, &invert) == 2) {
+        binaryThreshold = threshold;
+        invertColors = (invert != 0);
+      }
+      continue;
+    }
+    count += sscanf(line, "%d %d %d", &values[count], &values[count + 1], &values[count + 2]);
+  }
+  ok = ok && count == 3 && values[2] == 255 && values[0] > 0 && values[1] > 0 &&
+       values[0] <= PACKED_MAX_WIDTH && values[1] <= MAX_FRAME_ROWS;
+  if (ok) {
+    *width = values[0];
+    *height = values[1];
+    ok = fread(replayFrame, 1, *width * *height, file) == *width * *height;
+  }
+  fclose(file);
+  return ok;
+}
+
+// One frame through the /stream steps on top of the current detector state
+static bool replayNextFrame(const char* path) {
+  size_t width, height;
+  if (!readPgm(path, &width, &height)) {
+    fprintf(stderr, "%s: not a recordable PGM\n", path);
+    return false;
+  }
+  frameSequence++;
+  ensureFrameArena(width, height);
+  resetFrameArena();
+  measureScanlineContrast(replayFrame, width, height);
+  if (boundaryMonitorEnabled) monitorFieldBoundary(replayFrame, width, height);
+  if (!stageScanlineRows(replayFrame, width, height)) {
+    selectDetectorPipeline()->binarize(replayFrame, width, height);
+    applyBinaryFilters(replayFrame, width, height);
+  }
+  detectLineCenter(replayFrame, width, height);
+  finishBinarization();
+  return true;
+}
+
+static bool replayFile(const char* path, DetectionSnapshot& snapshot) {
+  clearDetectorHistory();
+  resetTemporalFilter();
+  pinDefaultSettings();
+  if (!replayNextFrame(path)) return false;
+  captureDetectionSnapshot(snapshot);
+  return true;
+}
+
+struct SequenceConfig {
+  const char* name;
+  int temporalFrames;
+  bool bridging;
+};
+
+static const SequenceConfig sequenceConfigs[] = {
+  {"plain", 0, false},
+  {"temporal-3", 3, false},
+  {"temporal-5", 5, false},
+  {"bridging", 0, true},
+  {"temporal-3+bridging", 3, true},
+};
+
+// Replay the frames in order under one configuration and print its row:
+// jitter is the RMS (and largest) change of lineCenterX between consecutive
+// frames that both have one; a dropout is a frame without a measured line,
+// of which some may still carry a bridged center
+static bool replaySequence(const SequenceConfig& config, char** paths, int count) {
+  clearDetectorHistory();
+  resetTemporalFilter();
+  pinDefaultSettings();
+  temporalFilterFrames = config.temporalFrames;
+  gapBridgingEnabled = config.bridging;
+  
+  int centers = 0, dropouts = 0, bridgedOnly = 0, longestDropout = 0, dropoutRun = 0;
+  int steps = 0, largestStep = 0;
+  double stepSquares = 0;
+  int previousX = -1;
+  for (int i = 0; i < count; i++) {
+    if (!replayNextFrame(paths[i])) return false;
+    if (lineCenterX >= 0) {
+      centers++;
+      if (previousX >= 0) {
+        int step = abs(lineCenterX - previousX);
+        stepSquares += (double)step * step;
+        if (step > largestStep) largestStep = step;
+        steps++;
+      }
+    }
+    previousX = lineCenterX;
+    if (lineMeasured()) {
+      dropoutRun = 0;
+    } else {
+      dropouts++;
+      if (lineCenterX >= 0) bridgedOnly++;
+      if (++dropoutRun > longestDropout) longestDropout = dropoutRun;
+    }
+  }
+  double jitter = steps > 0 ? sqrt(stepSquares / steps) : 0.0;
+  printf("%-22s %6d %7d %8d %7d %8d %10.2f %8d\n", config.name, count, centers, dropouts, bridgedOnly,
+         longestDropout, jitter, largestStep);
+  return true;
+}
+
+static int runSequenceReport(char** paths, int count) {
+  printf("%-22s %6s %7s %8s %7s %8s %10s %8s\n", "config", "frames", "centers", "dropouts", "bridged",
+         "longest", "jitter-rms", "max-step");
+  for (const SequenceConfig& config : sequenceConfigs) {
+    if (!replaySequence(config, paths, count)) return 2;
+  }
+  return 0;
+}
+
+static int loadApproved(const char* path, ReplayEntry* entries) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) return 0;
+  char line[160];
+  int count = 0;
+  while (count < REPLAY_MAX_FRAMES && fgets(line, sizeof(line), file)) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    ReplayEntry& entry = entries[count];
+    int c[4], s[4], angle, turn, corner;
+    if (sscanf(line, "%63s %d %d %d %d %d %d %d %d %d %d %d", entry.name, &c[0], &c[1], &c[2], &c[3],
+               &s[0], &s[1], &s[2], &s[3], &angle, &turn, &corner) != 12) {
+      continue;
+    }
+    for (int i = 0; i < 4; i++) {
+      entry.snapshot.centers[i] = c[i];
+      entry.snapshot.states[i] = s[i];
+    }
+    entry.snapshot.curveAngleCenti = angle;
+    entry.snapshot.turn = turn;
+    entry.snapshot.corner = corner;
+    count++;
+  }
+  fclose(file);
+  return count;
+}
+
+static void printSnapshot(FILE* out, const char* name, const DetectionSnapshot& snapshot) {
+  fprintf(out, "%s %d %d %d %d %u %u %u %u %d %d %u\n", name, snapshot.centers[0], snapshot.centers[1],
+          snapshot.centers[2], snapshot.centers[3], snapshot.states[0], snapshot.states[1], snapshot.states[2],
+          snapshot.states[3], snapshot.curveAngleCenti, snapshot.turn, snapshot.corner);
+}
+
+// Every event in the ring, as /trace would serve it
+static bool writeTrace(const char* path) {
+  size_t len = formatTraceJson(traceJsonBuffer, TRACE_JSON_SIZE, UINT32_MAX);
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    fprintf(stderr, "%s: cannot write\n", path);
+    return false;
+  }
+  bool ok = fwrite(traceJsonBuffer, 1, len, out) == len;
+  ok = fclose(out) == 0 && ok;
+  if (ok) printf("%lu trace events written to %s\n", (unsigned long)traceCount, path);
+  return ok;
+}
+
+// argv[0] is the first argument after the options
+static int runReplay(int argc, char** argv) {
+  if (strcmp(argv[0], "--sequence") == 0) return runSequenceReport(argv + 1, argc - 1);
+  
+  bool approve = strcmp(argv[1], "--approve") == 0;
+  int first = approve ? 2 : 1;
+
+  if (approve) {
+    FILE* out = fopen(argv[0], "w");
+    if (out == NULL) {
+      fprintf(stderr, "%s: cannot write\n", argv[0]);
+      return 2;
+    }
+    fprintf(out, "# Approved detector outputs (replay_frames --approve)\n");
+    fprintf(out, "# name centerX top middle bottom state0-3 angle-x100 turn corner\n");
+    for (int i = first; i < argc; i++) {
+      DetectionSnapshot snapshot;
+      char name[64];
+      if (!replayFile(argv[i], snapshot)) return 2;
+      frameName(argv[i], name, sizeof(name));
+      printSnapshot(out, name, snapshot);
+    }
+    fclose(out);
+    printf("%d frames approved in %s\n", argc - first, argv[0]);
+    return 0;
+  }
+
+  static ReplayEntry approved[REPLAY_MAX_FRAMES];
+  int approvedCount = loadApproved(argv[0], approved);
+  int mismatches = 0;
+  for (int i = first; i < argc; i++) {
+    DetectionSnapshot snapshot;
+    char name[64];
+    if (!replayFile(argv[i], snapshot)) return 2;
+    frameName(argv[i], name, sizeof(name));
+    const ReplayEntry* expected = NULL;
+    for (int k = 0; k < approvedCount; k++) {
+      if (strcmp(approved[k].name, name) == 0) expected = &approved[k];
+    }
+    if (expected != NULL && detectionSnapshotMatches(expected->snapshot, snapshot)) continue;
+    mismatches++;
+    printf("MISMATCH %s\n  actual   ", name);
+    printSnapshot(stdout, name, snapshot);
+    if (expected != NULL) {
+      printf("  approved ");
+      printSnapshot(stdout, name, expected->snapshot);
+    } else {
+      printf("  no approved outputs\n");
+    }
+  }
+  printf("%d/%d frames match\n", argc - first - mismatches, argc - first);
+  return mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  int first = 1;
+  const char* tracePath = NULL;
+  if (argc > 2 && strcmp(argv[1], "--trace") == 0) {
+    tracePath = argv[2];
+    first = 3;
+  }
+  if (argc - first < 2) {
+    fprintf(stderr, "usage: %s [--trace <file>] <approved> [--approve] <frame.pgm>...\n"
+                    "       %s [--trace <file>] --sequence <frame.pgm>...\n", argv[0], argv[0]);
+    return 2;
+  }
+  if (tracePath != NULL && (!LINE_TRACE || !initTraceRing())) {
+    fprintf(stderr, "--trace needs a -DLINE_TRACE=1 build\n");
+    return 2;
+  }
+  initTemporalFilter();
+  initColorDetection();
+  int result = runReplay(argc - first, argv + first);
+  if (tracePath != NULL && !writeTrace(tracePath)) return 2;
+  return result;
+}
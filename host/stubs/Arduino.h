@@ -0,0 +1,62 @@
+#pragma once
+// Minimal Arduino-ESP32 surface for building src/main.cpp on the host
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+typedef bool boolean;
+class String {
+ public:
+  std::string s;
+  String(const char* c = "") : s(c) {}
+  String(const std::string& c) : s(c) {}
+  String(int v) : s(std::to_string(v)) {}
+  String(unsigned v) : s(std::to_string(v)) {}
+  String(long v) : s(std::to_string(v)) {}
+  String(unsigned long v) : s(std::to_string(v)) {}
+  String(long long v) : s(std::to_string(v)) {}
+  String(unsigned long long v) : s(std::to_string(v)) {}
+  String(float v, int = 2) : s(std::to_string(v)) {}
+  String(double v, int = 2) : s(std::to_string(v)) {}
+  String& operator+=(const String& o) { s += o.s; return *this; }
+  String& operator+=(const char* o) { s += o; return *this; }
+  String& operator+=(char o) { s += o; return *this; }
+  friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+  friend String operator+(const char* a, const String& b) { return String(std::string(a) + b.s); }
+  friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+  bool operator==(const char* o) const { return s == o; }
+  bool operator==(const String& o) const { return s == o.s; }
+  bool operator!=(const char* o) const { return s != o; }
+  const char* c_str() const { return s.c_str(); }
+  unsigned length() const { return s.size(); }
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  bool reserve(unsigned n) { s.reserve(n); return true; }
+};
+struct HardwareSerial {
+  void begin(int) {}
+  template <typename... A> void printf(const char*, A...) {}
+  template <typename T> void println(T) {}
+  void println() {}
+  template <typename T> void print(T) {}
+};
+extern HardwareSerial Serial;
+void pinMode(int, int);
+void digitalWrite(int, int);
+void delay(unsigned long);
+unsigned long millis();
+unsigned long micros();
+template <class T, class L, class H> T constrain(T v, L l, H h) { return v < l ? l : (v > h ? h : v); }
+#define WRITE_PERI_REG(a, b)
+#define RTC_CNTL_BROWN_OUT_REG 0
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+struct EspClass { uint32_t getCycleCount() { return (uint32_t)(micros() * 240); } };
+inline EspClass ESP;
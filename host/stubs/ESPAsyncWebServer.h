@@ -0,0 +1,34 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <string>
+enum { HTTP_GET = 1, HTTP_POST = 2 };
+struct AsyncWebParameter { String text; String value() const { return text; } };
+struct AsyncWebServerResponse { int code = 0; void addHeader(const char*, const char*) {} void addHeader(const char*, const String&) {} };
+struct AsyncResponseStream : AsyncWebServerResponse { void print(const char*) {} void print(const String&) {} template <typename... A> void printf(const char*, A...) {} size_t write(const uint8_t*, size_t) { return 0; } size_t write(uint8_t) { return 0; } };
+// Host tests fill params and read status, the code of the last send
+struct AsyncWebServerRequest {
+  std::map<std::string, AsyncWebParameter> params;
+  int status = 0;
+  AsyncWebServerResponse response;
+  AsyncResponseStream stream;
+  bool hasParam(const char* name) { return params.count(name) != 0; }
+  AsyncWebParameter* getParam(const char* name) { auto it = params.find(name); return it == params.end() ? nullptr : &it->second; }
+  void send(int code, const char*, const String&) { status = code; }
+  void send(int code, const char*, const char*) { status = code; }
+  void send(AsyncWebServerResponse* r) { status = r->code; }
+  AsyncWebServerResponse* beginResponse(int code, const char*, const uint8_t*, size_t) { response.code = code; return &response; }
+  AsyncWebServerResponse* beginResponse(int code, const char*, const String&) { response.code = code; return &response; }
+  AsyncResponseStream* beginResponseStream(const char*) { stream.code = 200; return &stream; }
+};
+typedef std::function<void(AsyncWebServerRequest*)> ArRequestHandlerFunction;
+struct AsyncEventSourceClient {};
+struct AsyncEventSource { AsyncEventSource(const char*) {} void send(const char*, const char* = 0, uint32_t = 0, uint32_t = 0) {} size_t count() const { return 0; } };
+// Host tests call the handlers that setupRoutes() registered in routes
+struct AsyncWebServer {
+  std::map<std::string, ArRequestHandlerFunction> routes;
+  AsyncWebServer(int) {}
+  void on(const char* uri, int, ArRequestHandlerFunction handler) { routes[uri] = handler; }
+  void begin() {}
+  void addHandler(AsyncEventSource*) {}
+};
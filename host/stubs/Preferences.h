@@ -0,0 +1,18 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+class Preferences {
+ public:
+  bool begin(const char*, bool = false) { return true; }
+  void end() {}
+  size_t putBytes(const char*, const void*, size_t n) { return n; }
+  size_t getBytes(const char*, void*, size_t) { return 0; }
+  size_t getBytesLength(const char*) { return 0; }
+  size_t putInt(const char*, int32_t) { return 4; }
+  int32_t getInt(const char*, int32_t d = 0) { return d; }
+  size_t putBool(const char*, bool) { return 1; }
+  bool getBool(const char*, bool d = false) { return d; }
+  size_t putUChar(const char*, uint8_t) { return 1; }
+  uint8_t getUChar(const char*, uint8_t d = 0) { return d; }
+  bool clear() { return true; }
+};
@@ -0,0 +1,4 @@
+#pragma once
+struct IPAddress { String toString() { return String(""); } };
+struct WiFiClass { void softAP(const char*, const char*) {} IPAddress softAPIP() { return IPAddress(); } };
+extern WiFiClass WiFi;
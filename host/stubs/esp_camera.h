@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+typedef int esp_err_t;
+#define ESP_OK 0
+typedef enum { PIXFORMAT_RGB565, PIXFORMAT_YUV422, PIXFORMAT_YUV420, PIXFORMAT_GRAYSCALE, PIXFORMAT_JPEG } pixformat_t;
+typedef enum { FRAMESIZE_96X96 = 0, FRAMESIZE_QQVGA, FRAMESIZE_QCIF, FRAMESIZE_HQVGA, FRAMESIZE_240X240, FRAMESIZE_QVGA } framesize_t;
+typedef enum { GAINCEILING_2X } gainceiling_t;
+typedef enum { CAMERA_GRAB_WHEN_EMPTY, CAMERA_GRAB_LATEST } camera_grab_mode_t;
+typedef enum { CAMERA_FB_IN_PSRAM, CAMERA_FB_IN_DRAM } camera_fb_location_t;
+enum { LEDC_CHANNEL_0 = 0, LEDC_TIMER_0 = 0 };
+typedef struct { int ledc_channel, ledc_timer, pin_d0, pin_d1, pin_d2, pin_d3, pin_d4, pin_d5, pin_d6, pin_d7, pin_xclk, pin_pclk, pin_vsync, pin_href, pin_sccb_sda, pin_sccb_scl, pin_pwdn, pin_reset, xclk_freq_hz; pixformat_t pixel_format; framesize_t frame_size; int jpeg_quality; size_t fb_count; camera_fb_location_t fb_location; camera_grab_mode_t grab_mode; } camera_config_t;
+typedef struct { uint8_t* buf; size_t len; size_t width; size_t height; pixformat_t format; struct timeval timestamp; } camera_fb_t;
+typedef struct _sensor sensor_t;
+struct _sensor {
+  int (*set_framesize)(sensor_t*, framesize_t);
+  int (*set_pixformat)(sensor_t*, pixformat_t);
+  int (*set_brightness)(sensor_t*, int); int (*set_contrast)(sensor_t*, int); int (*set_saturation)(sensor_t*, int);
+  int (*set_sharpness)(sensor_t*, int); int (*set_ae_level)(sensor_t*, int); int (*set_agc_gain)(sensor_t*, int);
+  int (*set_gainceiling)(sensor_t*, gainceiling_t); int (*set_whitebal)(sensor_t*, int); int (*set_awb_gain)(sensor_t*, int);
+  int (*set_exposure_ctrl)(sensor_t*, int); int (*set_aec2)(sensor_t*, int); int (*set_aec_value)(sensor_t*, int);
+  int (*set_gain_ctrl)(sensor_t*, int); int (*set_bpc)(sensor_t*, int); int (*set_wpc)(sensor_t*, int);
+  int (*set_raw_gma)(sensor_t*, int); int (*set_lenc)(sensor_t*, int); int (*set_hmirror)(sensor_t*, int);
+  int (*set_vflip)(sensor_t*, int); int (*set_dcw)(sensor_t*, int); int (*set_colorbar)(sensor_t*, int);
+  int (*set_special_effect)(sensor_t*, int);
+};
+esp_err_t esp_camera_init(const camera_config_t*);
+sensor_t* esp_camera_sensor_get();
+camera_fb_t* esp_camera_fb_get();
+void esp_camera_fb_return(camera_fb_t*);
+esp_err_t esp_camera_deinit();
@@ -0,0 +1,12 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#define MALLOC_CAP_8BIT 1
+#define MALLOC_CAP_INTERNAL 2
+#define MALLOC_CAP_SPIRAM 4
+#define MALLOC_CAP_DMA 8
+#define MALLOC_CAP_32BIT 16
+void* heap_caps_malloc(size_t, uint32_t);
+size_t heap_caps_get_free_size(uint32_t);
+size_t heap_caps_get_largest_free_block(uint32_t);
+size_t heap_caps_get_minimum_free_size(uint32_t);
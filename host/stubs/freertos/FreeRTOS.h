@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+#define portNUM_PROCESSORS 2
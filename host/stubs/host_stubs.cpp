@@ -0,0 +1,35 @@
+// Host definitions of the Arduino and ESP-IDF functions src/main.cpp calls.
+// The camera, JPEG encoder and network are absent; heap_caps_malloc is malloc.
+#include "Arduino.h"
+#include "WiFi.h"
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+#include <chrono>
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+
+static auto startTime = std::chrono::steady_clock::now();
+
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+void delay(unsigned long) {}
+unsigned long micros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+unsigned long millis() { return micros() / 1000; }
+int64_t esp_timer_get_time() { return micros(); }
+
+esp_err_t esp_camera_init(const camera_config_t*) { return ESP_OK; }
+esp_err_t esp_camera_deinit() { return ESP_OK; }
+sensor_t* esp_camera_sensor_get() { return NULL; }
+camera_fb_t* esp_camera_fb_get() { return NULL; }
+void esp_camera_fb_return(camera_fb_t*) {}
+bool frame2jpg(camera_fb_t*, uint8_t, uint8_t**, size_t*) { return false; }
+bool fmt2jpg(uint8_t*, size_t, uint16_t, uint16_t, pixformat_t, uint8_t, uint8_t**, size_t*) { return false; }
+
+void* heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+size_t heap_caps_get_free_size(uint32_t) { return 100000; }
+size_t heap_caps_get_largest_free_block(uint32_t) { return 50000; }
+size_t heap_caps_get_minimum_free_size(uint32_t) { return 90000; }
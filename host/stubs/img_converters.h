@@ -0,0 +1,4 @@
+#pragma once
+#include "esp_camera.h"
+bool frame2jpg(camera_fb_t*, uint8_t, uint8_t**, size_t*);
+bool fmt2jpg(uint8_t*, size_t, uint16_t, uint16_t, pixformat_t, uint8_t, uint8_t**, size_t*);
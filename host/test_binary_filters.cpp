@@ -0,0 +1,170 @@
+// Packed-frame filters against a byte-per-pixel reference: erosion and
+// dilation (3x3, pixels outside the frame do not constrain the result), the
+// opening and closing applyBinaryFilters builds from them, and the 3- and
+// 5-frame temporal majority. Random frames of widths around the 32-pixel
+// word boundary, with the edge rows and columns compared like the rest.
+#include "../src/main.cpp"
+#include "test_check.h"
+
+static uint8_t frame[PACKED_MAX_WIDTH * PACKED_MAX_HEIGHT];
+static uint8_t expected[PACKED_MAX_WIDTH * PACKED_MAX_HEIGHT];
+static uint8_t scratch[PACKED_MAX_WIDTH * PACKED_MAX_HEIGHT];
+static uint8_t history[TEMPORAL_MAX_FRAMES][PACKED_MAX_WIDTH * PACKED_MAX_HEIGHT];
+static uint32_t randomState = 12345;
+
+static uint32_t nextRandom() {
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
+
+// Binarized frame: line color with the given probability (percent)
+static void randomFrame(uint8_t* out, size_t width, size_t height, int linePercent) {
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  for (size_t i = 0; i < width * height; i++) {
+    out[i] = ((int)(nextRandom() % 100) < linePercent) ? lineColor : 255 - lineColor;
+  }
+}
+
+// 3x3 erosion (all in-frame neighbours line) or dilation (any of them)
+static void referenceMorph(uint8_t* buf, size_t width, size_t height, bool erode) {
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  memcpy(scratch, buf, width * height);
+  for (int y = 0; y < (int)height; y++) {
+    for (int x = 0; x < (int)width; x++) {
+      bool all = true, any = false;
+      for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          int nx = x + dx, ny = y + dy;
+          if (nx < 0 || ny < 0 || nx >= (int)width || ny >= (int)height) continue;
+          bool line = scratch[ny * width + nx] == lineColor;
+          all = all && line;
+          any = any || line;
+        }
+      }
+      buf[y * width + x] = (erode ? all : any) ? lineColor : 255 - lineColor;
+    }
+  }
+}
+
+// First mismatching pixel, reported with the case that produced it
+static bool framesMatch(const char* what, size_t width, size_t height) {
+  for (size_t i = 0; i < width * height; i++) {
+    if (frame[i] != expected[i]) {
+      printf("%s %zux%zu: pixel (%zu, %zu) is %u, expected %u\n", what, width, height, i % width, i / width,
+             frame[i], expected[i]);
+      testFailures++;
+      return false;
+    }
+  }
+  return true;
+}
+
+static void startFrame(size_t width, size_t height) {
+  frameSequence++;
+  CHECK(ensureFrameArena(width, height));
+  resetFrameArena();
+}
+
+static const size_t widths[] = {1, 2, 5, 31, 32, 33, 63, 64, 65, 95, 96, 97, 100, 160, 250, 319, 320};
+static const size_t heights[] = {1, 2, 3, 7, 33, 120, 240};
+
+// erodePacked and dilatePacked on their own
+static void testErodeDilate() {
+  for (size_t w : widths) {
+    for (size_t h : heights) {
+      for (int erode = 0; erode <= 1; erode++) {
+        startFrame(w, h);
+        randomFrame(frame, w, h, erode ? 80 : 20);
+        memcpy(expected, frame, w * h);
+        referenceMorph(expected, w, h, erode);
+        CHECK(packBinaryFrame(frame, w, h));
+        if (erode) {
+          erodePacked();
+        } else {
+          dilatePacked();
+        }
+        unpackBinaryFrame(frame);
+        framesMatch(erode ? "erode" : "dilate", w, h);
+      }
+    }
+  }
+}
+
+// Opening, closing and both through applyBinaryFilters, for each line color
+static void testMorphFilters() {
+  temporalFilterFrames = 0;
+  for (int invert = 0; invert <= 1; invert++) {
+    invertColors = invert;
+    selectDetectorPipeline();
+    for (int mode = MORPH_OPEN; mode <= MORPH_OPEN_CLOSE; mode++) {
+      morphFilter = mode;
+      for (size_t w : widths) {
+        for (size_t h : heights) {
+          startFrame(w, h);
+          randomFrame(frame, w, h, 50);
+          memcpy(expected, frame, w * h);
+          if (mode == MORPH_OPEN || mode == MORPH_OPEN_CLOSE) {
+            referenceMorph(expected, w, h, true);
+            referenceMorph(expected, w, h, false);
+          }
+          if (mode == MORPH_CLOSE || mode == MORPH_OPEN_CLOSE) {
+            referenceMorph(expected, w, h, false);
+            referenceMorph(expected, w, h, true);
+          }
+          applyBinaryFilters(frame, w, h);
+          framesMatch(mode == MORPH_OPEN ? "open" : mode == MORPH_CLOSE ? "close" : "open-close", w, h);
+        }
+      }
+    }
+  }
+  morphFilter = MORPH_NONE;
+  invertColors = false;
+  selectDetectorPipeline();
+}
+
+// Majority of the last n input frames; the first n-1 frames after a reset
+// or a size change pass through
+static void testTemporalMajority() {
+  morphFilter = MORPH_NONE;
+  for (int n = 3; n <= 5; n += 2) {
+    temporalFilterFrames = n;
+    resetTemporalFilter();
+    uint8_t lineColor = activeDetectorPipeline->lineColor;
+    for (size_t w : widths) {
+      size_t h = heights[nextRandom() % (sizeof(heights) / sizeof(heights[0]))];
+      for (int f = 0; f < 2 * n + 1; f++) {
+        startFrame(w, h);
+        randomFrame(frame, w, h, 50);
+        memcpy(history[f % TEMPORAL_MAX_FRAMES], frame, w * h);
+        if (f < n - 1) {
+          memcpy(expected, frame, w * h);
+        } else {
+          for (size_t i = 0; i < w * h; i++) {
+            int votes = 0;
+            for (int k = 0; k < n; k++) {
+              votes += history[(f - k) % TEMPORAL_MAX_FRAMES][i] == lineColor;
+            }
+            expected[i] = (2 * votes > n) ? lineColor : 255 - lineColor;
+          }
+        }
+        applyBinaryFilters(frame, w, h);
+        char what[32];
+        snprintf(what, sizeof(what), "majority-%d frame %d", n, f);
+        framesMatch(what, w, h);
+      }
+    }
+  }
+  temporalFilterFrames = 0;
+}
+
+int main() {
+  initTemporalFilter();
+  CHECK(temporalRing != NULL);
+  pinDefaultSettings();
+  testErodeDilate();
+  testMorphFilters();
+  testTemporalMajority();
+  return testResult(__FILE__);
+}
@@ -0,0 +1,40 @@
+// Checks shared by the host unit tests (test_*.cpp): a failed check prints
+// its location and values and the test continues; testResult() is main's
+// exit code.
+#pragma once
+#include <stdio.h>
+#include <string.h>
+
+static int testFailures = 0;
+
+#define CHECK(condition)                                                                        \
+  do {                                                                                          \
+    if (!(condition)) {                                                                         \
+      printf("%s:%d: %s is false\n", __FILE__, __LINE__, #condition);                           \
+      testFailures++;                                                                           \
+    }                                                                                           \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                              \
+  do {                                                                                          \
+    long checkActual = (long)(actual), checkExpected = (long)(expected);                        \
+    if (checkActual != checkExpected) {                                                         \
+      printf("%s:%d: %s is %ld, expected %ld\n", __FILE__, __LINE__, #actual, checkActual,       \
+             checkExpected);                                                                    \
+      testFailures++;                                                                           \
+    }                                                                                           \
+  } while (0)
+
+// Substring of a formatted string, printed in full when it is missing
+#define CHECK_CONTAINS(text, part)                                                              \
+  do {                                                                                          \
+    if (strstr((text), (part)) == NULL) {                                                       \
+      printf("%s:%d: \"%s\" not in %s\n", __FILE__, __LINE__, (part), (text));                  \
+      testFailures++;                                                                           \
+    }                                                                                           \
+  } while (0)
+
+static int testResult(const char* file) {
+  printf("%s: %s\n", file, testFailures == 0 ? "ok" : "FAILED");
+  return testFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+// Frame accounting: fetched frames with driver timestamps go through
+// accountFetchedFrame and the captured and droppedGrab counters are checked
+// against the sensor frames that were actually skipped.
+#include "../src/main.cpp"
+#include "test_check.h"
+
+#define PERIOD_US 40000  // 25 fps
+
+static int64_t clockUs = 0;
+
+// One fetched frame, `periods` sensor periods after the previous one; jitter
+// in microseconds as the driver's timestamps have
+static void fetchAfter(int periods, int jitterUs = 0) {
+  clockUs += (int64_t)periods * PERIOD_US;
+  camera_fb_t fb = {};
+  int64_t ts = clockUs + jitterUs;
+  fb.timestamp.tv_sec = ts / 1000000;
+  fb.timestamp.tv_usec = ts % 1000000;
+  accountFetchedFrame(&fb);
+}
+
+static void startRun(int fps) {
+  sensorFrameRate = fps;
+  resetFrameStats();
+  clockUs = 1000000;
+  fetchAfter(0);
+}
+
+// Steady backpressure: /stream takes two periods per frame from the first
+// frame on, so no gap is ever one period. Only the configured rate shows it.
+static void testConstantDoubleGap() {
+  startRun(25);
+  for (int i = 0; i < 200; i++) fetchAfter(2);
+  CHECK_EQ(sensorFramePeriodUs, PERIOD_US);
+  CHECK_EQ(frameStats.fetched, 201);
+  CHECK_EQ(frameStats.captured, 401);
+  CHECK_EQ(frameStats.droppedGrab, 200);
+}
+
+// Backpressure that starts after a few frames at the sensor rate: the median
+// of the gaps moved to the doubled gap; the low end stays on the period
+static void testBackpressureAfterStart() {
+  startRun(0);
+  for (int i = 0; i < 4; i++) fetchAfter(1);
+  for (int i = 0; i < 200; i++) fetchAfter(2);
+  CHECK_EQ(sensorFramePeriodUs, PERIOD_US);
+  CHECK_EQ(frameStats.captured, 405);
+  CHECK_EQ(frameStats.droppedGrab, 200);
+}
+
+// Mixed gaps with timestamp jitter, including one short outlier
+static void testJitterAndOutlier() {
+  startRun(0);
+  const int gaps[] = {1, 1, 3, 1, 2, 1, 1, 4, 1, 2};
+  const int jitter[] = {300, -250, 120, -400, 0, 350, -100, 200, -300, 50};
+  int skipped = 0;
+  for (int i = 0; i < 10; i++) {
+    fetchAfter(gaps[i], jitter[i]);
+    skipped += gaps[i] - 1;
+  }
+  fetchAfter(1, -15000);  // One early timestamp: a short gap, then a long one
+  fetchAfter(1);
+  CHECK_EQ(frameStats.droppedGrab, skipped);
+  CHECK(sensorFramePeriodUs > PERIOD_US - 1000 && sensorFramePeriodUs < PERIOD_US + 1000);
+}
+
+// No drops: every frame fetched, nothing counted
+static void testNoDrops() {
+  startRun(25);
+  for (int i = 0; i < 100; i++) fetchAfter(1, (i % 3) * 150);
+  CHECK_EQ(frameStats.captured, 101);
+  CHECK_EQ(frameStats.droppedGrab, 0);
+}
+
+int main() {
+  testConstantDoubleGap();
+  testBackpressureAfterStart();
+  testJitterAndOutlier();
+  testNoDrops();
+  return testResult(__FILE__);
+}
@@ -0,0 +1,114 @@
+// Gap bridging: regions missing in a frame are filled from the fit over
+// recent frames, and a frame whose centers are all filled is not reported
+// as a detected line. Bridged centers add nothing to the confidence.
+#include "../src/main.cpp"
+#include "test_check.h"
+
+#define WIDTH 160
+static const int rows[3] = {30, 60, 100};  // Top, middle, bottom region rows
+
+static void frameWithCenters(int top, int middle, int bottom) {
+  lineCenterTop = top;
+  lineCenterMiddle = middle;
+  lineCenterBottom = bottom;
+  bridgeLineGaps(rows, WIDTH);
+}
+
+// Confidence of the frame just bridged, with lineCenterX from the bottom
+// region as the fuser picks it; the scanlines scored nothing, so measured
+// regions get the base of the refined searches
+static void scoreFrame() {
+  ScanlineResult results[4] = {};
+  for (int i = 0; i < 4; i++) results[i].state = SCANLINE_WHITE;
+  lineCenterX = lineCenterBottom;
+  computeDetectionConfidence(results, WIDTH);
+}
+
+static void startBridging() {
+  clearDetectorHistory();
+  gapBridgingEnabled = true;
+  gapBridgeMaxPixels = 48;
+  gapBridgeMaxFrames = 3;
+}
+
+// A dash under the middle row only: top and bottom come from the fit of
+// the previous frame's slanted line
+static void testPartialGap() {
+  startBridging();
+  frameWithCenters(70, 80, 100);
+  CHECK(lineMeasured());
+  frameWithCenters(-1, 81, -1);
+  CHECK(regionBridged[2] && !regionBridged[1]);
+  CHECK(lineBridged);
+  CHECK(lineMeasured());
+  CHECK(lineCenterFromFit());  // The bottom center the fuser prefers is a fit
+  CHECK(abs(lineCenterBottom - 100) <= 3);
+}
+
+// A bridged region scores at most the temporal quarter; the measured one
+// keeps its base, and the frame's confidence comes from it alone
+static void testBridgedConfidence() {
+  startBridging();
+  frameWithCenters(70, 80, 100);
+  scoreFrame();
+  int measuredBottom = regionConfidence[2];
+  frameWithCenters(-1, 81, -1);
+  scoreFrame();
+  CHECK(regionBridged[2]);
+  CHECK(regionConfidence[2] <= 25);
+  CHECK(regionConfidence[2] < measuredBottom);
+  CHECK(regionConfidence[1] > regionConfidence[2]);
+  CHECK(detectionConfidence > 0);
+}
+
+// Every center bridged: no detection, no confidence
+static void testWholeFrameConfidence() {
+  startBridging();
+  frameWithCenters(70, 80, 100);
+  scoreFrame();
+  CHECK(detectionConfidence > 0);
+  frameWithCenters(-1, -1, -1);
+  scoreFrame();
+  CHECK(lineCenterX >= 0);
+  CHECK_EQ(detectionConfidence, 0);
+  for (int r = 0; r < 3; r++) CHECK(regionConfidence[r] <= 25);
+}
+
+// Every scanline in the gap: centers from the fit, but no detection
+static void testWholeFrameBridged() {
+  startBridging();
+  frameWithCenters(70, 80, 100);
+  frameWithCenters(-1, -1, -1);
+  CHECK(lineBridged);
+  CHECK(lineCenterBottom >= 0);
+  CHECK(!lineMeasured());
+  CHECK(lineCenterFromFit());
+
+  // Past gapBridgeMaxFrames nothing is filled any more
+  for (int i = 0; i < gapBridgeMaxFrames; i++) frameWithCenters(-1, -1, -1);
+  CHECK(!lineBridged);
+  CHECK_EQ(lineCenterBottom, -1);
+  CHECK(!lineCenterFromFit());
+}
+
+// Bridging off: gaps stay gaps
+static void testDisabled() {
+  startBridging();
+  gapBridgingEnabled = false;
+  frameWithCenters(70, 80, 100);
+  frameWithCenters(-1, 81, -1);
+  CHECK(!lineBridged);
+  CHECK_EQ(lineCenterBottom, -1);
+  CHECK(lineMeasured());
+  CHECK(!lineCenterFromFit());
+}
+
+int main() {
+  CHECK(!gapBridgingEnabled);  // Off until gapPixels is set
+  testPartialGap();
+  testWholeFrameBridged();
+  testDisabled();
+  testBridgedConfidence();
+  testWholeFrameConfidence();
+  return testResult(__FILE__);
+}
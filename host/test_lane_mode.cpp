@@ -0,0 +1,59 @@
+// Lane mode: the black ratio of a row only counts pixels outside the
+// glare mask, as in the line mode classification.
+#include "../src/main.cpp"
+#include "test_check.h"
+
+#define WIDTH 160
+#define HEIGHT 8
+#define ROW 4
+
+static uint8_t frame[WIDTH * HEIGHT];
+
+// Each row dark except for glareWidth clipped pixels on the right
+static ScanlineResult scanWithGlare(int glareWidth) {
+  for (int y = 0; y < HEIGHT; y++) {
+    for (int x = 0; x < WIDTH; x++) {
+      frame[y * WIDTH + x] = (x >= WIDTH - glareWidth) ? 255 : 10;
+    }
+  }
+  frameSequence++;
+  selectDetectorPipeline()->binarize(frame, WIDTH, HEIGHT);
+  return analyzeScanline(frame, WIDTH, HEIGHT, ROW);
+}
+
+static void setUp() {
+  clearDetectorHistory();
+  laneModeEnabled = true;
+  glareMaskEnabled = true;
+  glareLevel = 250;
+  pyramidFactor = 0;
+}
+
+// Everything the camera can see is dark: black, although the glare
+// covers 40% of the row
+static void testGlareIgnoredInRatio() {
+  setUp();
+  ScanlineResult result = scanWithGlare(64);
+  CHECK_EQ(result.state, SCANLINE_BLACK);
+}
+
+// Without glare the same dark row is black as before
+static void testNoGlare() {
+  setUp();
+  ScanlineResult result = scanWithGlare(0);
+  CHECK_EQ(result.state, SCANLINE_BLACK);
+}
+
+// A row entirely under glare is undefined, not white
+static void testWholeRowMasked() {
+  setUp();
+  ScanlineResult result = scanWithGlare(WIDTH);
+  CHECK_EQ(result.state, SCANLINE_UNDEFINED);
+}
+
+int main() {
+  testGlareIgnoredInRatio();
+  testNoGlare();
+  testWholeRowMasked();
+  return testResult(__FILE__);
+}
@@ -0,0 +1,65 @@
+// Per-row line width learning: samples from learnLineWidth move the row's
+// expected width within twice the tolerance of the frame's constant width,
+// and no further however slowly they drift.
+#include "../src/main.cpp"
+#include "test_check.h"
+
+#define WIDTH 96
+#define ROW 60
+
+// One confident sample: a single run of the given width centered in the row
+static void sample(int lineWidth) {
+  int first = WIDTH / 2 - lineWidth / 2;
+  learnLineWidth(ROW, first, first + lineWidth - 1, 1, WIDTH);
+}
+
+static void startLearning() {
+  lineWidthLearningEnabled = true;
+  resetLearnedLineWidths();
+  frameLineWidth = EXPECTED_LINE_WIDTH;      // 12 at 96 wide
+  frameLineTolerance = LINE_WIDTH_THRESHOLD; // 4
+}
+
+// Perspective: a row where the line is 18 px learns 18 (inside 12 +- 8)
+static void testLearnsWithinGate() {
+  startLearning();
+  for (int i = 0; i < LEARN_WIDTH_SAMPLES; i++) sample(18);
+  CHECK_EQ(expectedLineWidthForRow(ROW), 18);
+  CHECK_EQ(expectedLineWidthForRow(ROW + 1), EXPECTED_LINE_WIDTH);  // Other rows keep the constant
+}
+
+// A blob that widens by one pixel per frame: each sample is within twice
+// the tolerance of the learned median, but the table stops at the gate
+static void testSlowDriftIsBounded() {
+  startLearning();
+  for (int lineWidth = 12; lineWidth <= 60; lineWidth++) {
+    for (int i = 0; i < 3; i++) sample(lineWidth);
+  }
+  int learned = expectedLineWidthForRow(ROW);
+  CHECK(learned <= EXPECTED_LINE_WIDTH + 2 * LINE_WIDTH_THRESHOLD);
+  CHECK(learned >= EXPECTED_LINE_WIDTH);
+}
+
+// Not confident: two runs, a run touching the frame edge, a width outside
+// the gate; and nothing is learned while learning is off
+static void testRejectedSamples() {
+  startLearning();
+  for (int i = 0; i < LEARN_WIDTH_SAMPLES; i++) {
+    learnLineWidth(ROW, 40, 55, 2, WIDTH);
+    learnLineWidth(ROW, 0, 15, 1, WIDTH);
+    learnLineWidth(ROW, WIDTH - 16, WIDTH - 1, 1, WIDTH);
+    sample(3);  // Below 12 - 8
+    sample(21); // Above 12 + 8
+  }
+  CHECK_EQ(widthSampleCount[ROW], 0);
+  lineWidthLearningEnabled = false;
+  for (int i = 0; i < LEARN_WIDTH_SAMPLES; i++) sample(16);
+  CHECK_EQ(widthSampleCount[ROW], 0);
+}
+
+int main() {
+  testLearnsWithinGate();
+  testSlowDriftIsBounded();
+  testRejectedSamples();
+  return testResult(__FILE__);
+}
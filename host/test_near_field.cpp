@@ -0,0 +1,95 @@
+// Near-field rows of the turn plans: their crossings are read every frame,
+// also when the bottom scanline still has the line, and feed the curve
+// estimate and the path.
+#include "../src/main.cpp"
+#include "test_check.h"
+
+#define WIDTH 160
+#define HEIGHT 120
+#define BEND_ROW 70
+
+static uint8_t frame[WIDTH * HEIGHT];
+
+// Line center of the test frame: straight down to BEND_ROW, then bending
+// right ever faster towards the robot
+static float lineCenterAt(int row) {
+  float below = (row > BEND_ROW) ? row - BEND_ROW : 0;
+  return 80 + below * below / 40;
+}
+
+// A 20 px black line on white through the /stream steps; sharpTurn selects
+// the turn plan, as a sharp turn in the previous frame does
+static void detectFrame(bool sharpTurn) {
+  for (int y = 0; y < HEIGHT; y++) {
+    float center = lineCenterAt(y);
+    for (int x = 0; x < WIDTH; x++) {
+      frame[y * WIDTH + x] = (fabs(x - center) < 10) ? 0 : 255;
+    }
+  }
+  clearDetectorHistory();
+  sharpTurnDetected = sharpTurn;
+  frameSequence++;
+  ensureFrameArena(WIDTH, HEIGHT);
+  resetFrameArena();
+  selectDetectorPipeline()->binarize(frame, WIDTH, HEIGHT);
+  detectLineCenter(frame, WIDTH, HEIGHT);
+}
+
+static void setUp() {
+  adaptiveScanlinesEnabled = true;
+  commandedSpeed = 0;
+  lineWidthLearningEnabled = false;
+  lineTracerEnabled = false;  // Path from the region centers and near-field points
+}
+
+// The bottom row has the line, and the near-field rows are read anyway,
+// nearest first
+static void testReadWithBottomFound() {
+  setUp();
+  detectFrame(true);
+  CHECK_EQ(activeScanlinePlan->count, 8);
+  CHECK(lineCenterBottom >= 0);
+  CHECK_EQ(lineRegionRows[2], activeScanlinePlan->rows[3]);
+  CHECK_EQ(nearFieldCount, 4);
+  for (int i = 1; i < nearFieldCount; i++) {
+    CHECK(nearFieldPoints[i].y < nearFieldPoints[i - 1].y);
+  }
+}
+
+// Their slope next to the robot steepens the curve angle of the bend
+static void testCurveUsesNearField() {
+  setUp();
+  detectFrame(true);
+  float withNearField = curveAngle;
+  nearFieldCount = 0;
+  detectCurveAndTurn(WIDTH);
+  CHECK(curveAngle > 0);
+  CHECK(withNearField > curveAngle + 1.0);
+}
+
+// The path follows the bend between the bottom and middle centers instead
+// of cutting it with a straight segment
+static void testPathUsesNearField() {
+  setUp();
+  detectFrame(true);
+  CHECK_EQ(pathWaypointCount, PATH_WAYPOINTS);
+  const PathWaypoint& near = pathWaypoints[1];
+  CHECK(fabs(near.x - lineCenterAt((int)near.y)) <= 1.5);
+}
+
+// The fixed plan has no near-field rows
+static void testFixedPlan() {
+  setUp();
+  adaptiveScanlinesEnabled = false;
+  detectFrame(true);
+  CHECK_EQ(nearFieldCount, 0);
+  CHECK(lineCenterBottom >= 0);
+}
+
+int main() {
+  testReadWithBottomFound();
+  testCurveUsesNearField();
+  testPathUsesNearField();
+  testFixedPlan();
+  return testResult(__FILE__);
+}
@@ -0,0 +1,87 @@
+// Self-tests: while a /bench or /golden run holds the detector, the
+// handlers that read its outputs or change settings answer 503, so a
+// /control write is neither lost to the restored settings nor mixed into
+// the run.
+#include "../src/main.cpp"
+#include "test_check.h"
+
+// Status code of one request to a route registered by setupRoutes()
+static int get(const char* uri, const char* name = NULL, const char* value = NULL) {
+  AsyncWebServerRequest request;
+  if (name != NULL) request.params[name].text = value;
+  server.routes.at(uri)(&request);
+  return request.status;
+}
+
+static int setControl(const char* name, const char* value) {
+  AsyncWebServerRequest request;
+  request.params["name"].text = name;
+  request.params["value"].text = value;
+  server.routes.at("/control")(&request);
+  return request.status;
+}
+
+// Where runPendingSelfTest and runGoldenCorpus are between two frames:
+// detector claimed, live state saved, settings pinned
+static PinnedSettings enterRun() {
+  CHECK(tryClaimDetector());
+  selfTestRunning = true;
+  CHECK(allocBenchBuffers());
+  saveDetectorState(savedDetectorState);
+  clearDetectorHistory();
+  return pinDefaultSettings();
+}
+
+static void leaveRun(const PinnedSettings& saved) {
+  restorePinnedSettings(saved);
+  restoreDetectorState(savedDetectorState);
+  selfTestRunning = false;
+  releaseDetector();
+}
+
+// A threshold set during the run is refused, not overwritten on restore
+static void testControlDuringRun() {
+  CHECK_EQ(setControl("threshold", "90"), 200);
+  PinnedSettings saved = enterRun();
+  CHECK_EQ(setControl("threshold", "60"), 503);
+  CHECK_EQ(binaryThreshold, 128);  // Still the pinned value
+  CHECK_EQ(get("/status"), 503);
+  CHECK_EQ(get("/path.bin"), 503);
+  CHECK_EQ(get("/calibrate"), 503);
+  CHECK_EQ(get("/save"), 503);
+  // A second run is not queued behind the running one
+  CHECK_EQ(get("/golden", "run", "1"), 202);
+  CHECK_EQ(selfTestPending, SELF_TEST_NONE);
+  leaveRun(saved);
+
+  CHECK_EQ(binaryThreshold, 90);
+  CHECK_EQ(get("/status"), 200);
+  CHECK_EQ(setControl("threshold", "60"), 200);
+  CHECK_EQ(binaryThreshold, 60);
+}
+
+// A whole /golden?run=1 from loop(): the handlers work again afterwards
+// and the live settings are the ones set before the run
+static void testGoldenRun() {
+  CHECK_EQ(setControl("threshold", "70"), 200);
+  CHECK_EQ(get("/golden", "run", "1"), 202);
+  CHECK_EQ(selfTestPending, SELF_TEST_GOLDEN);
+  CHECK_EQ(get("/golden"), 202);  // Queued
+  runPendingSelfTest();
+  CHECK(goldenHaveResults);
+  CHECK(!detectorBusy);
+  CHECK_EQ(binaryThreshold, 70);
+  CHECK_EQ(get("/golden"), 422);  // Nothing approved on the host
+  CHECK_EQ(get("/status"), 200);
+  CHECK_EQ(setControl("threshold", "80"), 200);
+  CHECK_EQ(binaryThreshold, 80);
+}
+
+int main() {
+  initTemporalFilter();
+  initColorDetection();
+  setupRoutes();
+  testControlDuringRun();
+  testGoldenRun();
+  return testResult(__FILE__);
+}
@@ -0,0 +1,153 @@
+// Task monitor: scheduler samples go through recordTaskSamples and the CPU
+// shares it derives from the run-time counters, and the /tasks JSON from
+// formatTaskStatsJson, are checked.
+#include "../src/main.cpp"
+#include "test_check.h"
+
+#define CORES 2
+
+static char json[TASK_JSON_SIZE];
+
+static TaskSample task(uint32_t id, const char* name, uint32_t runTime) {
+  TaskSample sample = {};
+  sample.id = id;
+  snprintf(sample.name, sizeof(sample.name), "%s", name);
+  sample.runTime = runTime;
+  sample.stackHighWater = 1000 + id;
+  sample.priority = id % 25;
+  sample.core = (id % 2) ? 1 : -1;
+  return sample;
+}
+
+static void resetTaskTable() {
+  memset(taskSlots, 0, sizeof(taskSlots));
+  taskRingHead = 0;
+  taskRingCount = 0;
+  taskLastTotalRunTime = 0;
+  taskTableOverflows = 0;
+  taskCpuStatsAvailable = true;
+}
+
+static const TaskSlot* findTask(uint32_t id) {
+  for (int t = 0; t < TASK_MAX_TRACKED; t++) {
+    if (taskSlots[t].used && taskSlots[t].last.id == id) return &taskSlots[t];
+  }
+  return NULL;
+}
+
+static uint16_t latestPermille(uint32_t id) {
+  const TaskSlot* slot = findTask(id);
+  if (slot == NULL) return 0xffff;
+  return slot->cpuPermille[(taskRingHead + TASK_RING_SAMPLES - 1) % TASK_RING_SAMPLES];
+}
+
+// Shares of all cores: 1000 ticks of two cores is 2000 task ticks
+static void testDeltaMath() {
+  resetTaskTable();
+  TaskSample first[2] = {task(1, "loop", 5000), task(2, "IDLE0", 7000)};
+  recordTaskSamples(first, 2, 100000, CORES);
+  CHECK_EQ(latestPermille(1), 0);  // No previous counter
+  CHECK_EQ(latestPermille(2), 0);
+
+  TaskSample second[2] = {task(1, "loop", 5000 + 500), task(2, "IDLE0", 7000 + 1500)};
+  recordTaskSamples(second, 2, 101000, CORES);
+  CHECK_EQ(latestPermille(1), 250);
+  CHECK_EQ(latestPermille(2), 750);
+  CHECK_EQ(taskRingCount, 2);
+}
+
+// Counters that wrap between samples: unsigned differences stay right
+static void testWraparound() {
+  resetTaskTable();
+  const uint32_t nearEnd = 0xffffffffu - 299;
+  TaskSample first[1] = {task(3, "stream", nearEnd)};
+  recordTaskSamples(first, 1, nearEnd - 100, CORES);
+  TaskSample second[1] = {task(3, "stream", nearEnd + 800)};  // Wrapped to 500
+  recordTaskSamples(second, 1, nearEnd - 100 + 2000, CORES);  // Wrapped to 1600
+  CHECK_EQ(second[0].runTime, 500);
+  CHECK_EQ(latestPermille(3), 200);
+}
+
+// A task that is gone frees its slot; one that comes back with the same
+// number starts over without a share from the stale counter
+static void testTaskDisappears() {
+  resetTaskTable();
+  TaskSample both[2] = {task(4, "ota", 1000), task(5, "wifi", 2000)};
+  recordTaskSamples(both, 2, 10000, CORES);
+  TaskSample onlyWifi[1] = {task(5, "wifi", 2400)};
+  recordTaskSamples(onlyWifi, 1, 11000, CORES);
+  CHECK(findTask(4) == NULL);
+  CHECK_EQ(latestPermille(5), 200);
+
+  TaskSample back[2] = {task(5, "wifi", 2800), task(4, "ota", 90000)};
+  recordTaskSamples(back, 2, 12000, CORES);
+  CHECK_EQ(latestPermille(4), 0);
+  CHECK_EQ(latestPermille(5), 200);
+
+  formatTaskStatsJson(json, sizeof(json), CORES);
+  const char* ota = strstr(json, "\"name\":\"ota\"");
+  CHECK(ota != NULL);
+  if (ota != NULL) CHECK_CONTAINS(ota, "\"history\":[0,0,0]");
+}
+
+// More tasks than slots: the rest are counted, not tracked
+static void testOverflow() {
+  resetTaskTable();
+  TaskSample many[TASK_MAX_TRACKED + 3];
+  for (int i = 0; i < TASK_MAX_TRACKED + 3; i++) many[i] = task(100 + i, "t", 0);
+  recordTaskSamples(many, TASK_MAX_TRACKED + 3, 1000, CORES);
+  CHECK_EQ(taskTableOverflows, 3);
+  formatTaskStatsJson(json, sizeof(json), CORES);
+  CHECK_CONTAINS(json, "\"overflows\":3");
+}
+
+// Without run-time stats every counter is 0: shares stay 0 and the JSON
+// says the CPU figures are not available
+static void testNoCpuStats() {
+  resetTaskTable();
+  taskCpuStatsAvailable = false;
+  TaskSample first[1] = {task(6, "async_tcp", 0)};
+  recordTaskSamples(first, 1, 0, CORES);
+  recordTaskSamples(first, 1, 0, CORES);
+  CHECK_EQ(latestPermille(6), 0);
+  formatTaskStatsJson(json, sizeof(json), CORES);
+  CHECK_CONTAINS(json, "{\"cpuStats\":false,\"cores\":2,");
+  CHECK_CONTAINS(json, "\"samples\":2,");
+  CHECK_CONTAINS(json, "\"cpu\":0.0,\"peakCpu\":0.0,\"history\":[0,0]");
+}
+
+// Field layout, the ring in oldest-first order after it wrapped, and the
+// name cut to FreeRTOS's 15 characters
+static void testJsonFormat() {
+  resetTaskTable();
+  TaskSample sample[1] = {task(7, "a_long_task_name_here", 0)};
+  uint32_t total = 0;
+  recordTaskSamples(sample, 1, total, 1);
+  for (int i = 1; i <= TASK_RING_SAMPLES + 2; i++) {
+    sample[0].runTime += 10 * i;  // i percent of the interval
+    total += 1000;
+    recordTaskSamples(sample, 1, total, 1);
+  }
+  size_t len = formatTaskStatsJson(json, sizeof(json), 1);
+  CHECK_EQ(len, strlen(json));
+  CHECK_CONTAINS(json, "\"periodMs\":500,\"samples\":16,\"overflows\":0,\"tasks\":[{");
+  CHECK_CONTAINS(json, "\"name\":\"a_long_task_nam\",\"core\":1,\"priority\":7,\"stackFree\":1007,");
+  CHECK_CONTAINS(json, "\"cpu\":18.0,\"peakCpu\":18.0,");
+  CHECK_CONTAINS(json, "\"history\":[30,40,50,60,70,80,90,100,110,120,130,140,150,160,170,180]}]}");
+
+  // Too small a buffer gives an error object, not cut-off JSON
+  char small[64];
+  len = formatTaskStatsJson(small, sizeof(small), 1);
+  CHECK_EQ(len, strlen(small));
+  CHECK(strcmp(small, "{\"error\":\"task table too large\"}") == 0);
+}
+
+int main() {
+  testDeltaMath();
+  testWraparound();
+  testTaskDisappears();
+  testOverflow();
+  testNoCpuStats();
+  testJsonFormat();
+  return testResult(__FILE__);
+}
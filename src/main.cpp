@@ -1,11 +1,14 @@
 #include <Arduino.h>
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
+#include <Preferences.h>
 #include "esp_camera.h"
 #include "esp_timer.h"
+#include "esp_heap_caps.h"
 #include "img_converters.h"
 #include "soc/soc.h"
 #include "soc/rtc_cntl_reg.h"
+#include <stdarg.h>
 
 // WiFi credentials - update these for your network
 const char* ssid = "ESP32-CAM-LineDetector";
@@ -14,6 +17,12 @@ const char* password = "12345678";
 // Create AsyncWebServer object on port 80
 AsyncWebServer server(80);
 
+// Non-volatile storage for settings and learned detection parameters
+Preferences preferences;
+
+// Server-sent events: per-frame path updates for downstream planners
+AsyncEventSource events("/events");
+
 // LED Flash pin for ESP32-CAM
 #define LED_FLASH 4
 
@@ -21,19 +30,281 @@ AsyncWebServer server(80);
 int binaryThreshold = 128; // Auto-calibrated threshold for 1-bit conversion
 bool invertColors = false; // false = black line on white, true = white line on black
 int lineCenterX = -1; // Detected line center X position (-1 if not detected)
+bool detectorLogEnabled = true; // Per-frame scanline and result lines on Serial
 
 // Line width constants (distance from camera to field is constant)
 const int EXPECTED_LINE_WIDTH = 12; // Expected line width in pixels at 96x96 resolution
 const int LINE_WIDTH_THRESHOLD = 4; // Tolerance for line width detection (±4 pixels)
+const int LINE_WIDTH_REFERENCE = 96; // Frame width the line width constants are measured at
+int frameLineWidth = EXPECTED_LINE_WIDTH;      // Expected line width scaled to the current frame width
+int frameLineTolerance = LINE_WIDTH_THRESHOLD; // Width tolerance scaled to the current frame width
+
+const int MAX_FRAME_ROWS = 240; // Tallest supported frame (QVGA) for per-row tables
+const int MIN_FRAME_WIDTH = 16;  // Smallest frame the detector analyzes: the scanline
+const int MIN_FRAME_HEIGHT = 16; // plan needs distinct rows inside the 5-row edge margins
+
+// Self-learned expected line width per row (perspective makes the line wider
+// near the robot): median of the last LEARN_WIDTH_SAMPLES confident widths
+#define LEARN_WIDTH_SAMPLES 9
+#define LEARN_WIDTH_MIN_SAMPLES 5
+bool lineWidthLearningEnabled = true;
+uint8_t widthSamples[MAX_FRAME_ROWS][LEARN_WIDTH_SAMPLES];
+uint8_t widthSampleCount[MAX_FRAME_ROWS];
+uint8_t widthSampleHead[MAX_FRAME_ROWS];
+uint8_t learnedLineWidth[MAX_FRAME_ROWS]; // 0 = not learned yet
+int learnedForFrameWidth = 0;             // Frame width the table was learned at
+int scanlineLineWidths[4] = {0, 0, 0, 0}; // Expected width used at the 4 scanlines
+
+// Coarse-to-fine pyramid scanning for larger frames (QQVGA and up)
+#define PYRAMID_MIN_WIDTH 160 // Below this width rows are scanned flat
+int pyramidFactor = 4;        // Coarse level downsampling factor (0 = off, 2 or 4)
 
 // Curve and turn detection parameters
 int lineCenterTop = -1;    // Line position in top region
 int lineCenterMiddle = -1; // Line position in middle region
 int lineCenterBottom = -1; // Line position in bottom region
+int lineRegionRows[3] = {-1, -1, -1}; // Row each region center was measured on (top, middle, bottom)
 float curveAngle = 0.0;    // Estimated curve angle in degrees
 bool sharpTurnDetected = false; // True if sharp turn (>45°) detected
 String turnDirection = "straight"; // "left", "right", or "straight"
 
+// Gap bridging for dashed and broken lines: missing regions are filled from
+// a line fitted to region centers of the current and recent frames
+#define BRIDGE_HISTORY_FRAMES 8 // Frames of region observations kept for the fit
+struct BridgeObservation {
+  int16_t row;
+  int16_t x;
+  uint32_t frame;
+};
+bool gapBridgingEnabled = false; // Off by default: bridged centers move more than measured ones
+int gapBridgeMaxPixels = 48;  // Max vertical distance (px) to extrapolate from a present region
+int gapBridgeMaxFrames = 3;   // Max age (frames) of observations used to bridge
+bool lineBridged = false;     // At least one region was filled by bridging this frame
+bool regionBridged[3] = {false, false, false}; // Per region (top, middle, bottom): center came from the fit
+BridgeObservation bridgeHistory[3 * BRIDGE_HISTORY_FRAMES];
+int bridgeHistoryHead = 0;
+uint32_t bridgeFrameCounter = 0;
+float lastFitSlope = 0.0;     // Slope dx/dy of the last fit over distinct rows
+uint32_t lastFitFrame = 0;    // bridgeFrameCounter of that fit (0 = none)
+
+// Field boundary monitor: sparse samples of the outermost rows and columns
+// (grayscale, before binarization) compared with the learned field level
+#define BOUNDARY_SAMPLES 16          // Samples per frame side
+#define BOUNDARY_ENTER_PERCENT 50    // Share of off-field samples that flags a side
+#define BOUNDARY_EXIT_PERCENT 30     // Share below which a flagged side clears
+enum BoundarySide {
+  BOUNDARY_TOP = 1,
+  BOUNDARY_BOTTOM = 2,
+  BOUNDARY_LEFT = 4,
+  BOUNDARY_RIGHT = 8
+};
+bool boundaryMonitorEnabled = true;
+int boundaryDelta = 60;              // Gray levels from the field level that count as off-field
+int fieldLevel = -1;                 // Learned field gray level (-1 = not learned yet)
+uint8_t boundarySides = 0;           // BoundarySide bits flagged in the last frame
+int boundaryOffField[4] = {0, 0, 0, 0}; // Off-field samples per side (%): top, bottom, left, right
+uint32_t boundaryEventCount = 0;     // Times a side became flagged
+uint32_t boundaryEventFrame = 0;     // frameSequence of the last event
+
+// Speed-adaptive scanline planner. Plans are precomputed per frame size for
+// every speed/curvature level; the detector only indexes the table.
+// Rows 0-3 keep the top/upper-middle/lower-middle/bottom roles, rows 4+ are
+// extra near-field rows added in turns.
+#define PLAN_MAX_ROWS 8           // 4 primary rows + up to 4 near-field rows
+#define PLAN_SPEED_LEVELS 4
+#define PLAN_CURVE_LEVELS 3       // Straight, curve, sharp turn
+#define SCANLINE_PIXEL_BUDGET 2048 // Max pixels scanned by planned rows per frame
+struct ScanlinePlan {
+  uint8_t count;                  // Rows in this plan (4..PLAN_MAX_ROWS)
+  int16_t rows[PLAN_MAX_ROWS];
+};
+bool adaptiveScanlinesEnabled = false;
+int commandedSpeed = 0;           // 0-100 %, reported by the drive controller
+ScanlinePlan scanlinePlans[PLAN_SPEED_LEVELS][PLAN_CURVE_LEVELS];
+ScanlinePlan fixedScanlinePlan;   // Original fixed rows (planner off)
+int scanlinePlanWidth = 0;        // Frame size the plans were built for
+int scanlinePlanHeight = 0;
+const ScanlinePlan* activeScanlinePlan = &fixedScanlinePlan;
+
+// Detection confidence (0-100, integer only) and per-scanline outcome statistics
+#define CONTRAST_FULL_SCORE 80          // Line/field contrast (gray levels) that scores 100
+int scanlineContrast[4] = {0, 0, 0, 0}; // Line/field contrast per scanline, measured before binarization
+int scanlineConfidence[4] = {0, 0, 0, 0};
+int regionConfidence[3] = {0, 0, 0};    // Top, middle, bottom
+int detectionConfidence = 0;            // Overall confidence of lineCenterX
+int prevRegionCenters[3] = {-1, -1, -1};
+int prevLineCenterX = -1;
+uint32_t scanlineStateCounts[4][4];     // [scanline][ScanlineState] outcomes since boot/reset
+uint8_t scanlineStates[4] = {3, 3, 3, 3}; // ScanlineState of the 4 scanlines in the last frame
+
+// 90-degree corner detection with vertical (column) scanlines
+bool columnScanEnabled = true;  // Run column analysis when rows suggest a corner
+#define CORNER_MIN_INWARD_RUN 1.25 // Row run inward from a one-sided exit, in line widths
+                                   // (1/(2 tan) of the angle to horizontal: ~22 degrees)
+bool cornerDetected = false;    // True if line leaves the frame through a side edge
+String cornerExitSide = "none"; // "left", "right", "both" or "none"
+int cornerExitY = -1;           // Row where the line crosses the side column (-1 if none)
+
+// Bottom-up centerline tracer (ordered polyline from the nearest detection)
+#define TRACE_MAX_POINTS 48   // Fixed polyline buffer size
+#define TRACE_WINDOW 6        // Search window (±pixels) around the predicted center
+#define TRACE_MAX_MISSES 3    // Consecutive rows without the line before giving up
+struct TracePoint {
+  int16_t x;
+  int16_t y;
+};
+bool lineTracerEnabled = true;
+TracePoint tracePoints[TRACE_MAX_POINTS];
+int traceLength = 0;         // Number of valid points in tracePoints
+float traceTurnAngle = 0.0;  // Heading change along the polyline in degrees (positive = right)
+float traceCurvature = 0.0;  // Signed curvature in 1/px (positive = right)
+
+// Crossings on the scanline plan's near-field rows (turn plans only), nearest
+// to the robot first: extra points for the curve estimate and the path
+#define NEAR_FIELD_MAX_POINTS (PLAN_MAX_ROWS - 4)
+TracePoint nearFieldPoints[NEAR_FIELD_MAX_POINTS];
+int nearFieldCount = 0;
+
+// Frame pipeline accounting. Sensor frames are counted from the driver's
+// frame timestamps: a gap of N sensor periods between two fetched frames
+// means N-1 frames were overwritten by CAMERA_GRAB_LATEST.
+#define FRAME_STALE_PERIODS 2 // Served frame older than this many periods is stale
+struct FrameStats {
+  uint32_t captured;       // Sensor frames (estimated from timestamps)
+  uint32_t fetched;        // Frames handed to /stream by the driver
+  uint32_t processed;      // Frames that went through detection
+  uint32_t droppedGrab;    // Sensor frames never fetched (overwritten while /stream was busy)
+  uint32_t droppedCapture; // esp_camera_fb_get() failures
+  uint32_t droppedFormat;  // Frames in an unsupported pixel format
+  uint32_t droppedEncode;  // Processed frames that could not be encoded and served
+  uint32_t staleServed;    // Served frames older than FRAME_STALE_PERIODS or repeated
+};
+FrameStats frameStats;
+int64_t lastFrameTimestampUs = -1; // Driver timestamp of the previous fetched frame
+uint32_t sensorFramePeriodUs = 0;  // Sensor frame period (0 = unknown)
+uint32_t shortestFrameGapsUs[2];   // Two shortest gaps since the camera settings changed
+int frameGapCount = 0;
+int sensorFrameRate = 0;           // Configured sensor rate in fps (0 = estimate from the gaps)
+int64_t lastServedTimestampUs = -1; // Driver timestamp of the last served frame
+uint32_t lastFrameAgeUs = 0;       // Capture to serve time of the last frame
+uint32_t servedIntervalUs = 0;     // Smoothed interval between served results (1/control rate)
+int64_t lastServedUs = -1;
+
+// Per-task CPU and stack monitoring. loop() samples the FreeRTOS task list
+// every TASK_SAMPLE_PERIOD_MS; the aggregation and JSON formatting below only
+// use plain C types so they also build and run on a Linux host.
+#define TASK_MAX_TRACKED 24       // Task slots (ESP32 Arduino runs ~15 tasks)
+#define TASK_RING_SAMPLES 16      // CPU history per task
+#define TASK_SAMPLE_PERIOD_MS 500
+#define TASK_JSON_SIZE 6144
+struct TaskSample {               // One task as read from the scheduler
+  uint32_t id;                    // FreeRTOS task number
+  char name[16];
+  uint32_t runTime;               // Cumulative run-time counter (0 without run-time stats)
+  uint32_t stackHighWater;        // Minimum free stack ever seen
+  uint8_t priority;
+  int8_t core;                    // Pinned core, -1 = no affinity or unknown
+};
+struct TaskSlot {                 // Tracked task with its CPU history
+  TaskSample last;                // Latest sample (runTime is the previous counter)
+  bool used;
+  bool alive;                     // Present in the latest sample
+  uint16_t cpuPermille[TASK_RING_SAMPLES]; // Share of all cores per interval
+};
+TaskSlot taskSlots[TASK_MAX_TRACKED];
+int taskRingHead = 0;             // Next history column
+int taskRingCount = 0;            // Valid history columns
+uint32_t taskLastTotalRunTime = 0;
+bool taskCpuStatsAvailable = false; // Run-time counters are enabled in this build
+uint32_t taskTableOverflows = 0;  // Tasks that did not fit the table or sample buffer
+uint32_t lastTaskSampleMs = 0;
+char* taskJsonBuffer = NULL;      // TASK_JSON_SIZE bytes (PSRAM)
+
+// Heap telemetry: internal RAM and PSRAM sampled from loop() every
+// HEAP_SAMPLE_PERIOD_MS into a ring, plus allocation counters of the paths
+// that allocate per request (JPEG encoding, /status and main page Strings)
+#define HEAP_SAMPLE_PERIOD_MS 10000
+#define HEAP_RING_SAMPLES 32      // 32 x 10 s = last 5 minutes
+struct HeapRegionStats {
+  uint32_t freeBytes;
+  uint32_t largestBlock;          // Largest allocatable block
+  uint32_t minimumFree;           // Lowest free size since boot
+};
+struct HeapSample {
+  uint32_t uptimeS;
+  HeapRegionStats internal;
+  HeapRegionStats psram;
+};
+struct AllocStats {
+  uint32_t jpegBuffers;           // fmt2jpg output buffers
+  uint32_t jpegBytes;
+  uint32_t jpegFailures;
+  uint32_t statusResponses;       // /status JSON Strings
+  uint32_t statusBytes;
+  uint32_t pageResponses;         // Main page Strings
+  uint32_t pageBytes;
+};
+HeapSample heapRing[HEAP_RING_SAMPLES];
+int heapRingHead = 0;
+int heapRingCount = 0;
+HeapSample heapLatest;
+AllocStats allocStats;
+int heapWarnInternalKb = 24;      // Warn below this much free or largest-block internal RAM
+bool heapWarning = false;
+uint32_t heapWarningCount = 0;    // Transitions into the warning state
+uint32_t lastHeapSampleMs = 0;
+// Warning raised in loop(), published by the next async_tcp handler: the
+// event source is not safe to use from two tasks
+volatile bool heapEventPending = false;
+uint32_t heapEventFree = 0;
+uint32_t heapEventLargest = 0;
+uint32_t heapEventMs = 0;
+
+// Look-ahead path: fixed-size waypoints along the detected line, resampled
+// from points the detector already found (tracer polyline or region centers)
+#define PATH_WAYPOINTS 5
+struct PathWaypoint {
+  float x;        // Image coordinates (px)
+  float y;
+  float heading;  // Degrees from straight ahead (positive = right)
+  float groundX;  // Ground plane, mm to the right of the camera axis
+  float groundY;  // Ground plane, mm ahead of the camera (-1 = above horizon)
+};
+PathWaypoint pathWaypoints[PATH_WAYPOINTS]; // Nearest first
+int pathWaypointCount = 0;  // 0 (no line), 1 (single point) or PATH_WAYPOINTS
+
+// Flat-floor pinhole model for ground coordinates
+int cameraHeightMm = 0;     // Lens height above the floor (0 = ground output off)
+int cameraPitchDeg = 45;    // Downward tilt of the optical axis
+int cameraHfovDeg = 60;     // Horizontal field of view
+
+// Binary telemetry record served by /path.bin (little-endian, packed)
+#define PATH_RECORD_MAGIC 0x5057 // "WP"
+#define PATH_RECORD_VERSION 3
+struct __attribute__((packed)) PathTelemetryRecord {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t count;           // Valid waypoints
+  uint32_t frame;          // frameSequence the path belongs to
+  uint32_t timestampMs;
+  uint32_t framesCaptured; // FrameStats at the time of the record
+  uint32_t framesProcessed;
+  uint32_t framesDropped;  // All drop causes together
+  uint32_t framesStale;
+  uint16_t frameAgeMs;     // Capture to serve time of the last frame
+  uint16_t heapInternalFreeKb;    // Last heap sample
+  uint16_t heapInternalLargestKb;
+  uint16_t heapPsramFreeKb;
+  uint8_t heapWarning;
+  struct __attribute__((packed)) {
+    int16_t x;             // 0.1 px
+    int16_t y;             // 0.1 px
+    int16_t heading;       // 0.01 degree
+    int16_t groundX;       // mm
+    int16_t groundY;       // mm
+  } waypoints[PATH_WAYPOINTS];
+};
+
 // Camera pins for AI-Thinker ESP32-CAM
 #define PWDN_GPIO_NUM     32
 #define RESET_GPIO_NUM    -1
@@ -67,14 +338,367 @@ struct CameraSettings {
   int ae_level = 0;    // -2 to 2 (not used when AEC disabled)
   int agc_gain = 5;    // 0-30, fixed manual gain value
   int gainceiling = 2; // 0-6
+  int colorMode = 0;   // 0 = grayscale, 1 = YUV422 (luma for lines + chroma for markers)
 } settings;
 
+// Memory placement of the per-frame hot path, selected at build time:
+//   -DLINE_HOT_IRAM=1   binarization and row scan kernels in IRAM
+//   -DLINE_SRAM_ROWS=1  planned scanline rows binarized straight into internal
+//                       SRAM, the rest of the frame (in PSRAM) only when read
+#ifndef LINE_HOT_IRAM
+#define LINE_HOT_IRAM 0
+#endif
+#ifndef LINE_SRAM_ROWS
+#define LINE_SRAM_ROWS 0
+#endif
+#if LINE_HOT_IRAM
+#define HOT_KERNEL IRAM_ATTR
+#else
+#define HOT_KERNEL
+#endif
+
+// Per-frame bump arena for detector scratch data: the packed frames and
+// small per-frame tables. Sized from the frame geometry (reallocated only
+// when it changes) and reset at the start of every frame. Running
+// out is a hard failure: the allocation returns NULL and is counted (or
+// aborts with -DFRAME_ARENA_STRICT=1), it never falls back to malloc.
+// Host builds with AddressSanitizer poison everything outside live
+// allocations, with a red zone after each one.
+#ifndef FRAME_ARENA_STRICT
+#define FRAME_ARENA_STRICT 0
+#endif
+#define ARENA_ALIGN 8
+#define ARENA_SMALL_BYTES 512 // Small per-frame tables (path resampling points)
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define ARENA_REDZONE 16
+#define ARENA_POISON(p, n) ASAN_POISON_MEMORY_REGION(p, n)
+#define ARENA_UNPOISON(p, n) ASAN_UNPOISON_MEMORY_REGION(p, n)
+#else
+#define ARENA_REDZONE 0
+#define ARENA_POISON(p, n) ((void)0)
+#define ARENA_UNPOISON(p, n) ((void)0)
+#endif
+struct FrameArena {
+  uint8_t* base;
+  size_t capacity;
+  size_t used;
+  size_t highWater;   // Largest use of any frame since boot
+  uint32_t failures;  // Allocations that did not fit
+};
+FrameArena frameArena = {NULL, 0, 0, 0, 0};
+
+// Cycle counts of the frame stages (last frame and running mean)
+struct StageCycles {
+  uint32_t last;
+  uint32_t mean;  // Exponential mean, 1/16 per frame
+};
+StageCycles binarizeCycles = {0, 0}; // Binarization and binary filters
+StageCycles stageCycles = {0, 0};    // Copy of scanline rows to internal SRAM
+StageCycles detectCycles = {0, 0};   // detectLineCenter
+
+// Cycle profiling of instrumented code regions, enabled at build time with
+// -DLINE_PROFILE=1 (otherwise PROFILE_REGION() compiles to nothing).
+// PROFILE_REGION(id) reads the cycle counter where it is declared and again
+// when the enclosing scope ends; /profile reports min/mean/max per region.
+// Regions nest (scanline time is part of detect). The counter is CCOUNT on
+// the ESP32 (CPU cycles), rdtsc on x86 hosts and clock_gettime() ns elsewhere.
+#ifndef LINE_PROFILE
+#define LINE_PROFILE 0
+#endif
+#if defined(__XTENSA__)
+#define PROFILE_UNIT "cycles"
+static inline uint32_t profileCounter() { return ESP.getCycleCount(); }
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILE_UNIT "tsc"
+static inline uint32_t profileCounter() { return (uint32_t)__rdtsc(); }
+#else
+#include <time.h>
+#define PROFILE_UNIT "ns"
+static inline uint32_t profileCounter() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+#endif
+enum ProfileRegion {
+  PROF_BINARIZE,    // Binarizer policy (threshold or glare mask)
+  PROF_FILTERS,     // applyBinaryFilters
+  PROF_STAGE_ROWS,  // stageScanlineRows
+  PROF_DETECT,      // detectLineCenterWithScanlines
+  PROF_SCANLINE,    // analyzeScanline (one row)
+  PROF_TRACER,      // traceLineFromBottom
+  PROF_CURVE,       // detectCurveAndTurn
+  PROF_JPEG,        // fmt2jpg in /stream
+  PROF_STREAM,      // Whole /stream request
+  PROF_CAPTURE,     // esp_camera_fb_get (waiting for the sensor)
+  PROF_STATUS,      // /status request
+  PROF_REGION_COUNT
+};
+const char* const profileRegionNames[PROF_REGION_COUNT] = {
+  "binarize", "filters", "stageRows", "detect", "scanline", "tracer", "curve", "jpeg",
+  "stream", "capture", "status"
+};
+#define PROFILE_JSON_SIZE 1536
+struct ProfileStats {
+  uint32_t count;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+};
+ProfileStats profileStats[PROF_REGION_COUNT];
+uint32_t profileOverhead = 0;  // Counter reads of an empty region (not subtracted)
+
+static inline void recordProfileSample(uint8_t region, uint32_t cycles) {
+  ProfileStats& stats = profileStats[region];
+  if (stats.count == 0 || cycles < stats.minCycles) stats.minCycles = cycles;
+  if (cycles > stats.maxCycles) stats.maxCycles = cycles;
+  stats.totalCycles += cycles;
+  stats.count++;
+}
+
+// Timeline tracing of the same regions, enabled with -DLINE_TRACE=1: each
+// region becomes one complete event (start, duration, task) in a fixed ring
+// that /trace exports as Chrome trace_event JSON (chrome://tracing, Perfetto).
+#ifndef LINE_TRACE
+#define LINE_TRACE 0
+#endif
+#define TRACE_RING_EVENTS 4096     // ~5 s of all stages at 30 fps
+#define TRACE_MAX_TASKS 8
+#define TRACE_JSON_SIZE (TRACE_RING_EVENTS * 96 + 2048)
+struct TraceEvent {
+  uint32_t startUs;                // Low 32 bits of esp_timer_get_time()
+  uint32_t durationUs;
+  uint8_t region;                  // ProfileRegion
+  uint8_t task;                    // Index into traceTasks
+};
+struct TraceTask {
+  void* handle;                    // FreeRTOS task handle (NULL on host)
+  char name[16];
+};
+TraceEvent* traceRing = NULL;      // TRACE_RING_EVENTS events (PSRAM)
+uint32_t traceHead = 0;            // Next slot
+uint32_t traceCount = 0;           // Valid events in the ring
+uint32_t traceRecorded = 0;        // Events since boot
+uint32_t traceDropped = 0;         // Events lost while an export was running
+TraceTask traceTasks[TRACE_MAX_TASKS];
+int traceTaskCount = 0;
+bool traceEnabled = true;
+bool traceExporting = false;
+uint32_t traceRegionMask = ~((uint32_t)1 << PROF_SCANLINE); // Per-row events would flood the ring
+char* traceJsonBuffer = NULL;      // TRACE_JSON_SIZE bytes (PSRAM)
+#if defined(__XTENSA__)
+portMUX_TYPE traceLock = portMUX_INITIALIZER_UNLOCKED;
+#define TRACE_LOCK() portENTER_CRITICAL(&traceLock)
+#define TRACE_UNLOCK() portEXIT_CRITICAL(&traceLock)
+#else
+#define TRACE_LOCK() ((void)0)
+#define TRACE_UNLOCK() ((void)0)
+#endif
+
+static inline uint32_t traceNowUs() { return (uint32_t)esp_timer_get_time(); }
+void recordTraceEvent(uint8_t region, uint32_t startUs, uint32_t durationUs);
+
+struct ProfileScope {
+  uint8_t region;
+  uint32_t start;
+#if LINE_TRACE
+  uint32_t startUs;
+  explicit ProfileScope(uint8_t id) : region(id), start(profileCounter()),
+    startUs(((traceRegionMask >> id) & 1) ? traceNowUs() : 0) {}
+  ~ProfileScope() {
+    recordProfileSample(region, profileCounter() - start);
+    if ((traceRegionMask >> region) & 1) recordTraceEvent(region, startUs, traceNowUs() - startUs);
+  }
+#else
+  explicit ProfileScope(uint8_t id) : region(id), start(profileCounter()) {}
+  ~ProfileScope() { recordProfileSample(region, profileCounter() - start); }
+#endif
+};
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#if LINE_PROFILE || LINE_TRACE
+#define PROFILE_REGION(id) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(id)
+#else
+#define PROFILE_REGION(id) ((void)0)
+#endif
+
+// Kernel benchmark and regression gate (/bench). Runs the hot kernels on
+// synthetic frames per resolution and dataset, keeps min and median counter
+// ticks (profileCounter units) and compares the minimum (the least noisy
+// statistic) against a baseline stored in NVS with a per-kernel tolerance.
+#define BENCH_REPEATS 9
+#define BENCH_BATCH 4              // Calls per sample of the short kernels
+#define BENCH_SCANLINE_ROWS 8      // analyzeScanline rows per batch
+#define BENCH_MIN_DELTA_TICKS 100  // Smaller differences per sample are counter noise
+#define BENCH_JSON_SIZE (BENCH_KERNEL_COUNT * BENCH_SIZE_COUNT * BENCH_DATASET_COUNT * 200 + 128)
+#define BENCH_EDGE_COLUMN 5        // Side columns detectCornerWithColumns reads
+enum BenchKernel {
+  BENCH_BINARIZE,   // convertTo1Bit, whole frame
+  BENCH_SCANLINE,   // analyzeScanline, per row (pyramid factor 4)
+  BENCH_SCANLINE_PYRAMID2, // analyzeScanline with pyramid factor 2
+  BENCH_SCANLINE_FLAT,     // analyzeScanline with the pyramid off
+  BENCH_DETECT,     // detectLineCenterWithScanlines, whole frame (pyramid factor 4)
+  BENCH_DETECT_PYRAMID2, // detectLineCenterWithScanlines with pyramid factor 2
+  BENCH_DETECT_FLAT, // detectLineCenterWithScanlines with the pyramid off
+  BENCH_TRACER,     // traceLineFromBottom from the detected bottom-most center
+  BENCH_COLUMNS,    // analyzeColumn of both side columns, strips transposed per call
+  BENCH_COLUMNS_STRIDED, // analyzeColumnBytes of the same columns (strided byte reads)
+  BENCH_MORPH,      // applyBinaryFilters with open-close (pack, 4 packed passes, unpack)
+  BENCH_MORPH_BYTES, // The same open-close on the byte frame
+  BENCH_TEMPORAL,   // applyBinaryFilters with the 5-frame majority
+  BENCH_TEMPORAL_BYTES, // The same majority over 5 byte frames
+  BENCH_FRAME_GRAY_PATH, // Grayscale frame: binarize (or stage rows) and detect, up to the path
+  BENCH_FRAME_GRAY, // The same plus the rest of the binarization /stream does for the JPEG
+  BENCH_FRAME_YUV,  // YUV422 frame: deinterleaveYUV422, then the same on the luma plane
+  BENCH_JPEG,       // fmt2jpg of the binarized frame
+  BENCH_KERNEL_COUNT
+};
+enum BenchDataset {
+  BENCH_STRAIGHT,   // Vertical line in the center
+  BENCH_CURVE,      // Line bending to the right edge
+  BENCH_EMPTY,      // Floor noise only
+  BENCH_DATASET_COUNT
+};
+#define BENCH_SIZE_COUNT 3
+const char* const benchKernelNames[BENCH_KERNEL_COUNT] = {
+  "convertTo1Bit", "analyzeScanline", "analyzeScanline:pyramid2", "analyzeScanline:flat",
+  "detectLineCenterWithScanlines", "detectLineCenterWithScanlines:pyramid2", "detectLineCenterWithScanlines:flat",
+  "traceLineFromBottom", "columnsTransposed", "columnsStrided", "morphOpenClose", "morphOpenClose:bytes",
+  "temporalMajority5", "temporalMajority5:bytes", "frameGrayscale:path", "frameGrayscale", "frameYUV422", "jpegEncode"
+};
+const char* const benchDatasetNames[BENCH_DATASET_COUNT] = {"straight", "curve", "empty"};
+const uint16_t benchSizes[BENCH_SIZE_COUNT][2] = {{96, 96}, {160, 120}, {320, 240}};
+struct BenchResult {
+  uint32_t minTicks;
+  uint32_t medianTicks;
+};
+typedef BenchResult BenchTable[BENCH_KERNEL_COUNT][BENCH_SIZE_COUNT][BENCH_DATASET_COUNT];
+BenchTable benchResults;
+BenchTable benchBaseline;
+bool benchHaveBaseline = false;
+uint8_t benchTolerancePct[BENCH_KERNEL_COUNT] = {10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 15}; // JPEG output size varies more
+// Calls timed together in one sample; results are per call, the counter noise is per sample
+const uint8_t benchCallsPerSample[BENCH_KERNEL_COUNT] = {
+  1, BENCH_SCANLINE_ROWS * BENCH_BATCH, BENCH_SCANLINE_ROWS * BENCH_BATCH, BENCH_SCANLINE_ROWS * BENCH_BATCH,
+  BENCH_BATCH, BENCH_BATCH, BENCH_BATCH, BENCH_BATCH, BENCH_BATCH, BENCH_BATCH, 1, 1, 1, 1, 1, 1, 1, 1
+};
+uint8_t* benchSource = NULL;       // Synthetic grayscale frame (PSRAM)
+uint8_t* benchFrame = NULL;        // Working copy the kernels modify (PSRAM)
+char* benchJsonBuffer = NULL;      // BENCH_JSON_SIZE bytes (PSRAM)
+volatile int benchSink = 0;        // Results of timed calls that have no side effects
+uint8_t* benchHistory = NULL;      // TEMPORAL_MAX_FRAMES byte frames for the filter references (PSRAM, per run)
+uint8_t* benchYuv = NULL;          // YUYV copy of benchSource (PSRAM, per run)
+struct PinnedSettings {            // Live settings saved while bench/golden runs use defaults
+  bool log;
+  int threshold;
+  bool invert;
+  bool glare;
+  bool learning;
+  bool bridging;
+  bool lane;
+  bool adaptivePlan;
+  int pyramid;
+  bool tracer;
+  bool columnScan;
+  int morph;
+  int temporal;
+};
+
+// Self-tests (/bench, /golden) run in loop(): they take seconds, which would stall the
+// async_tcp task, and they reuse the detector globals and pin the settings, so
+// every handler that reads detector outputs or writes settings (/stream, /status,
+// /control, ...) answers 503 while one holds the detector. Handlers only queue
+// a run and read results.
+enum SelfTest {
+  SELF_TEST_NONE,
+  SELF_TEST_BENCH,
+  SELF_TEST_BENCH_SAVE,  // Bench, then store the run as the baseline
+  SELF_TEST_GOLDEN,
+  SELF_TEST_GOLDEN_APPROVE // Golden corpus, then approve its outputs
+};
+volatile int selfTestPending = SELF_TEST_NONE;  // Queued by a handler, taken by loop()
+volatile bool selfTestRunning = false;
+volatile int selfTestFinished = SELF_TEST_NONE; // Completion event for the async_tcp side
+bool benchHaveResults = false;     // benchResults holds a completed run
+bool goldenHaveResults = false;    // goldenActual holds a completed run
+bool benchBuffersFailed = false;   // Last run could not allocate its buffers
+bool detectorBusy = false;         // /stream or a self-test owns the detector globals
+#if defined(__XTENSA__)
+portMUX_TYPE detectorLock = portMUX_INITIALIZER_UNLOCKED;
+#define DETECTOR_LOCK() portENTER_CRITICAL(&detectorLock)
+#define DETECTOR_UNLOCK() portEXIT_CRITICAL(&detectorLock)
+#else
+#define DETECTOR_LOCK() ((void)0)
+#define DETECTOR_UNLOCK() ((void)0)
+#endif
+
+static bool tryClaimDetector() {
+  DETECTOR_LOCK();
+  bool claimed = !detectorBusy;
+  detectorBusy = true;
+  DETECTOR_UNLOCK();
+  return claimed;
+}
+
+static void releaseDetector() {
+  DETECTOR_LOCK();
+  detectorBusy = false;
+  DETECTOR_UNLOCK();
+}
+
+// Detector ownership for the rest of a scope (released on every return path)
+struct DetectorClaim {
+  bool owned;
+  DetectorClaim() : owned(tryClaimDetector()) {}
+  ~DetectorClaim() {
+    if (owned) releaseDetector();
+  }
+};
+
+// Golden-output check (/golden): detector outputs for the synthetic bench
+// frames compared field by field against approved outputs stored in NVS.
+// /frame.pgm records real frames for the same comparison on a host.
+struct DetectionSnapshot {
+  int16_t centers[4];              // lineCenterX, top, middle, bottom (-1 = none)
+  uint8_t states[4];               // ScanlineState of the 4 scanlines
+  int16_t curveAngleCenti;         // curveAngle x 100
+  int8_t turn;                     // -1 left, 0 straight, 1 right
+  uint8_t corner;                  // cornerDetected
+};
+#define GOLDEN_FRAMES (BENCH_SIZE_COUNT * BENCH_DATASET_COUNT)
+DetectionSnapshot goldenApproved[GOLDEN_FRAMES];
+DetectionSnapshot goldenActual[GOLDEN_FRAMES];
+uint32_t goldenTicks[GOLDEN_FRAMES];
+bool goldenHaveApproved = false;
+int goldenCenterTolerance = 2;     // Pixels
+int goldenAngleToleranceCenti = 200; // 2 degrees
+uint8_t* framePgmBuffer = NULL;    // PGM header + largest supported frame (PSRAM)
+#define FRAME_PGM_HEADER 96
+
 void applyCameraSettings();
 void calibrateCamera();
 void detectLineCenter(uint8_t* grayscale_buf, size_t width, size_t height);
 void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t height);
 void detectCurveAndTurn(size_t width);
 void convertTo1Bit(uint8_t* grayscale_buf, size_t len);
+void convertTo1BitInto(const uint8_t* grayscale_buf, uint8_t* binary_buf, size_t len);
+void convertTo1BitWithGlareMask(uint8_t* grayscale_buf, size_t width, size_t height);
+bool stageScanlineRows(uint8_t* grayscale_buf, size_t width, size_t height);
+void finishBinarization();
+void recordStageCycles(StageCycles& stage, uint32_t cycles);
+void resetProfileStats();
+size_t formatProfileJson(char* out, size_t size);
+bool initTraceRing();
+size_t formatTraceJson(char* out, size_t size, uint32_t windowUs);
+bool runKernelBenchmarks();
+size_t formatBenchJson(char* out, size_t size, bool* passed);
+bool runGoldenCorpus();
+size_t formatGoldenJson(char* out, size_t size, bool* passed);
+bool ensureFrameArena(size_t width, size_t height);
+void resetFrameArena();
+void* arenaAlloc(size_t bytes);
 
 // Scanning line analysis result
 enum ScanlineState {
@@ -89,13 +713,242 @@ struct ScanlineResult {
   int transitionStart; // Where line starts (for CROSSED state)
   int transitionEnd;   // Where line ends (for CROSSED state)
   int blackPixelCount; // Count of black pixels
+  int runCount;        // Number of separate line-colored runs
+  int lastRunStart;    // Start of the last run (right boundary in lane mode)
+  int lastRunEnd;      // End of the last run
+};
+
+// Per-row values the row scan policies report besides the ScanlineResult fields
+struct RowScan {
+  int firstLinePixel;
+  int lastLinePixel;
+  int maskedCount;
+};
+
+// Detector pipeline: one prebuilt policy instantiation (see LineDetector)
+typedef void (*BinarizeFn)(uint8_t* buf, size_t width, size_t height);
+typedef void (*RowScanFn)(const uint8_t* rowPtr, const uint32_t* maskRow, size_t width, ScanlineResult& result, RowScan& out);
+typedef void (*RowPackFn)(const uint8_t* rowPtr, const uint32_t* maskRow, size_t width, uint32_t* out);
+typedef void (*FuseFn)(uint8_t* buf, size_t width, size_t height);
+typedef void (*CurveFn)(size_t width);
+struct DetectorPipeline {
+  const char* name;
+  uint8_t lineColor;       // Pixel value of the line after binarization
+  bool glareMask;          // Binarizer builds the glare mask
+  BinarizeFn binarize;
+  RowScanFn scanRow;       // Row without glare mask
+  RowScanFn scanMaskedRow; // Row with a glare mask row
+  RowPackFn packRow;       // Row to 1 bit per pixel (packed frame)
+  FuseFn fuse;
+  CurveFn estimateCurve;
 };
+extern const DetectorPipeline detectorPipelines[];
+const DetectorPipeline* activeDetectorPipeline = &detectorPipelines[0];
+const DetectorPipeline* selectDetectorPipeline();
+
+// Two-line lane mode: the track is bounded by two parallel lines and the
+// detector follows the lane center between them
+bool laneModeEnabled = false;
+int16_t laneWidthByRow[MAX_FRAME_ROWS];  // Learned boundary-to-boundary width per row (0 = unknown)
+int16_t laneCenterByRow[MAX_FRAME_ROWS]; // Last lane center per row (-1 = unknown)
+int laneWidthBottom = 0;           // Learned lane width at the bottom scanline
+bool laneBoundaryMissing = false;  // A boundary was extrapolated from the learned width this frame
+
+void classifyLaneScanline(ScanlineResult& result, size_t width, int knownPixels, int row);
+void resetLaneModel();
 
 // Analyze a single horizontal scanline
-ScanlineResult analyzeScanline(uint8_t* grayscale_buf, size_t width, int row);
+ScanlineResult analyzeScanline(uint8_t* grayscale_buf, size_t width, size_t height, int row);
+void classifyScanline(ScanlineResult& result, size_t length, int firstBlackPixel, int lastBlackPixel, int expectedWidth);
+int expectedLineWidthForRow(int row);
+void learnLineWidth(int row, int firstBlackPixel, int lastBlackPixel, int runCount, size_t width);
+void resetLearnedLineWidths();
+void loadSettings();
+void saveSettings();
+void saveBenchBaseline();
+void saveGoldenOutputs();
+void measureScanlineContrast(const uint8_t* grayscale_buf, size_t width, size_t height);
+void monitorFieldBoundary(const uint8_t* grayscale_buf, size_t width, size_t height);
+void accountFetchedFrame(const camera_fb_t* fb);
+void accountServedFrame(const camera_fb_t* fb);
+void resetFrameStats();
+uint32_t droppedFrameCount();
+void recordTaskSamples(const TaskSample* samples, int count, uint32_t totalRunTime, int cores);
+void jsonAppend(char* out, size_t size, size_t& len, const char* format, ...) __attribute__((format(printf, 4, 5)));
+size_t formatTaskStatsJson(char* out, size_t size, int cores);
+void sampleTaskStats();
+void sampleHeapStats();
+void publishHeapEvent();
+void runPendingSelfTest();
+void publishSelfTestEvent();
+void computeDetectionConfidence(const ScanlineResult* results, size_t width);
+void resetScanlineStats();
+void bridgeLineGaps(const int* regionRows, size_t width);
+bool lineMeasured();
+bool lineCenterFromFit();
+ScanlineResult analyzeScanlineCoarseToFine(uint8_t* grayscale_buf, size_t width, int row);
+void buildScanlinePlans(size_t width, size_t height);
+void buildPathWaypoints(size_t width, size_t height);
+String pathToJson();
+const ScanlinePlan* planScanlines(size_t width, size_t height);
+
+// Packed 1-bit frame: one bit per pixel (LSB first), bit set = line color.
+// Columns are read from a transposed copy so a vertical scanline is a few
+// sequential words instead of one strided byte per row.
+#define PACKED_MAX_WIDTH  320
+#define PACKED_MAX_HEIGHT 240
+#define PACKED_WORDS(n) (((n) + 31) / 32)
+uint32_t* packedFrame = NULL;   // Frame arena, valid until the next reset
+uint32_t* packedColumns = NULL;
+int packedWidth = 0;
+int packedHeight = 0;
+int packedAllocWidth = 0;  // Geometry the arena buffers above were allocated for
+int packedAllocHeight = 0;
+
+// Frame sizes the detection core handles; other frames are still streamed
+// but not analyzed (per-row and packed tables end at QVGA)
+static inline bool detectorFrameSupported(size_t width, size_t height) {
+  return width >= MIN_FRAME_WIDTH && width <= PACKED_MAX_WIDTH &&
+         height >= MIN_FRAME_HEIGHT && height <= MAX_FRAME_ROWS;
+}
+int packedRowWords = 0;
+uint32_t transposedStrips = 0; // Bit per 32-column strip already transposed this frame
+uint32_t frameSequence = 0;       // Incremented for every processed frame
+uint32_t packedFrameSequence = 0; // frameSequence the packed frame was built from
+
+// Scanline rows binarized into internal SRAM for this frame (LINE_SRAM_ROWS)
+#if LINE_SRAM_ROWS
+DRAM_ATTR uint8_t stagedRowData[PLAN_MAX_ROWS][PACKED_MAX_WIDTH];
+#endif
+int16_t stagedRowIndex[PLAN_MAX_ROWS];
+uint8_t stagedRowSlot[MAX_FRAME_ROWS]; // stagedRowData index + 1 of each staged row, 0 = not staged
+int stagedRowCount = 0;
+int stagedRowWidth = 0;
+uint32_t stagedRowSequence = 0;   // frameSequence the rows were staged for
+uint8_t* stagedRowFrame = NULL;   // Frame buffer they were staged from
+int stagedFrameHeight = 0;
+bool stagedFramePending = false;  // Rest of that frame still grayscale
+uint32_t deferredRowDone[MAX_FRAME_ROWS]; // frameSequence each row of it was binarized in place
+
+// True while buf is the frame stageScanlineRows() left grayscale outside
+// the staged rows
+static inline bool binarizationDeferred(const uint8_t* buf) {
+  return LINE_SRAM_ROWS && stagedFramePending && stagedRowSequence == frameSequence && stagedRowFrame == buf;
+}
+
+// Binarize one row of a frame whose binarization is deferred, in place and
+// once per frame; finishBinarization() skips it
+static inline void binarizeDeferredRow(uint8_t* buf, size_t width, int row) {
+  if (deferredRowDone[row] == frameSequence) return;
+  convertTo1Bit(buf + row * width, width);
+  deferredRowDone[row] = frameSequence;
+}
+
+// The same for one column. The threshold maps 0 and 255 to themselves, so
+// the pixels binarized again with their rows do not change.
+static void binarizeDeferredColumn(uint8_t* buf, size_t width, size_t height, int col) {
+  uint8_t threshold = binaryThreshold;
+  for (size_t y = 0; y < height; y++) {
+    uint8_t& pixel = buf[y * width + col];
+    pixel = (pixel < threshold) ? 0 : 255;
+  }
+}
+
+// Row pointer for the scanline analyzers: the SRAM row when it was staged
+// this frame, otherwise the frame buffer (binarized first while deferred)
+static inline const uint8_t* scanlineRowPtr(uint8_t* buf, size_t width, int row) {
+#if LINE_SRAM_ROWS
+  if (stagedRowSequence == frameSequence && stagedRowFrame == buf && stagedRowWidth == (int)width) {
+    int slot = stagedRowSlot[row];
+    if (slot > 0) return stagedRowData[slot - 1];
+    if (stagedFramePending) binarizeDeferredRow(buf, width, row);
+  }
+#endif
+  return buf + row * width;
+}
+
+// Morphological filtering of the packed frame (3x3 square structuring element)
+enum MorphFilter {
+  MORPH_NONE,       // No filtering
+  MORPH_OPEN,       // Remove isolated line-colored specks (noise, floor texture)
+  MORPH_CLOSE,      // Fill small holes in the line (glare, dirt)
+  MORPH_OPEN_CLOSE  // Both, opening first
+};
+int morphFilter = MORPH_NONE;
+uint32_t* packedScratch = NULL; // Frame arena, allocated with packedFrame
+
+// Glare mask: clipped pixels in runs of 3 or more (specular highlights) are
+// marked during binarization and treated as unknown by the scanline analysis
+bool glareMaskEnabled = false;
+int glareLevel = 250;       // Pixels at or above this level are clipped
+uint32_t glareMask[PACKED_MAX_HEIGHT * PACKED_WORDS(PACKED_MAX_WIDTH)];
+uint32_t glareMaskSequence = 0; // frameSequence the mask was built for
+int glareMaskWidth = 0;
+int glarePixelCount = 0;    // Masked pixels in the last frame
+
+// Glare mask row for the current frame, or NULL if there is none
+static inline const uint32_t* glareMaskRow(size_t width, int row) {
+  if (!glareMaskEnabled || glareMaskSequence != frameSequence || glareMaskWidth != (int)width) return NULL;
+  return glareMask + row * PACKED_WORDS(width);
+}
+
+// Temporal per-pixel majority over the last packed frames (suppresses flicker
+// at the threshold boundary). Ring lives in PSRAM, allocated once at startup.
+#define TEMPORAL_MAX_FRAMES 5
+int temporalFilterFrames = 0;     // 0 = off, 3 or 5 frames
+uint32_t* temporalRing = NULL;    // TEMPORAL_MAX_FRAMES packed frames
+int temporalRingHead = 0;         // Slot for the next frame
+int temporalRingCount = 0;        // Valid frames in the ring
+int temporalRingWords = 0;        // Words per frame the ring was filled with
+int temporalRingWidth = 0;        // Width of those frames (same words, other size)
+
+bool packBinaryFrame(const uint8_t* binary_buf, size_t width, size_t height);
+void unpackBinaryFrame(uint8_t* binary_buf);
+void erodePacked();
+void dilatePacked();
+void initTemporalFilter();
+void resetTemporalFilter();
+void applyTemporalFilter();
+void applyBinaryFilters(uint8_t* binary_buf, size_t width, size_t height);
+
+// Color marker detection in YUV422 mode
+enum ColorClass {
+  COLOR_NONE,
+  COLOR_RED,    // Stop zones
+  COLOR_GREEN,
+  COLOR_BLUE,   // Branch markers
+  COLOR_YELLOW,
+  COLOR_CLASS_COUNT
+};
+const char* colorClassNames[COLOR_CLASS_COUNT] = {"none", "red", "green", "blue", "yellow"};
 
+struct ColorMarker {
+  int pixelCount; // Chroma samples of this class (one sample per 2 pixels)
+  int centerX;    // Centroid in full-resolution pixels (-1 if not detected)
+  int centerY;
+};
+ColorMarker colorMarkers[COLOR_CLASS_COUNT];
+
+#define UV_LUT_BITS 5                  // U and V quantized to 32 levels each
+#define COLOR_MIN_SATURATION 28        // Minimum chroma magnitude to classify a color
+#define COLOR_MIN_PIXELS_PERCENT 1     // Marker needs at least 1% of chroma samples
+uint8_t uvClassLut[1 << (2 * UV_LUT_BITS)]; // (U, V) -> ColorClass
+uint8_t* lumaBuffer = NULL;                 // Deinterleaved Y plane (PSRAM)
+uint8_t* colorClassMap = NULL;              // ColorClass per pixel pair (PSRAM)
+
+void initColorDetection();
+void deinterleaveYUV422(const uint8_t* yuv_buf, size_t width, size_t height);
+uint8_t* lumaFromFrame(camera_fb_t* fb);
+ScanlineResult analyzeColumn(int col);
+ScanlineResult analyzeColumnBytes(const uint8_t* binary_buf, size_t width, size_t height, int col);
+void detectCornerWithColumns(uint8_t* grayscale_buf, const ScanlineResult* rowResults, size_t width, size_t height);
+
+// Follow the line upward from a seed point and fill tracePoints
+void traceLineFromBottom(uint8_t* grayscale_buf, size_t width, size_t height, int seedX, int seedRow);
 
-void initCamera() {
+
+// Returns false if the driver or sensor did not come up (s is NULL then)
+bool initCamera() {
   camera_config.ledc_channel = LEDC_CHANNEL_0;
   camera_config.ledc_timer = LEDC_TIMER_0;
   camera_config.pin_d0 = Y2_GPIO_NUM;
@@ -115,7 +968,8 @@ void initCamera() {
   camera_config.pin_pwdn = PWDN_GPIO_NUM;
   camera_config.pin_reset = RESET_GPIO_NUM;
   camera_config.xclk_freq_hz = 20000000;
-  camera_config.pixel_format = PIXFORMAT_GRAYSCALE; // Use grayscale for minimal processing
+  // Use grayscale for minimal processing, YUV422 when colored markers are needed
+  camera_config.pixel_format = settings.colorMode ? PIXFORMAT_YUV422 : PIXFORMAT_GRAYSCALE;
   camera_config.frame_size = (framesize_t)settings.framesize;
   camera_config.jpeg_quality = 12; // Not used for grayscale but needs to be set
   camera_config.fb_count = 1;
@@ -125,13 +979,14 @@ void initCamera() {
   esp_err_t err = esp_camera_init(&camera_config);
   if (err != ESP_OK) {
     Serial.printf("Camera init failed with error 0x%x\n", err);
-    return;
+    s = NULL;
+    return false;
   }
 
   s = esp_camera_sensor_get();
   if (s == NULL) {
     Serial.println("Failed to get camera sensor");
-    return;
+    return false;
   }
 
   applyCameraSettings();
@@ -139,15 +994,22 @@ void initCamera() {
   // FIXED: Initialize LED flash pin and keep it OFF (disabled for now)
   pinMode(LED_FLASH, OUTPUT);
   digitalWrite(LED_FLASH, LOW); // Keep LED off - not needed
+  return true;
 }
 
 void applyCameraSettings() {
   if (s == NULL) return;
 
+  // The frame period may change with the new settings
+  lastFrameTimestampUs = -1;
+  sensorFramePeriodUs = 0;
+  frameGapCount = 0;
+
   s->set_framesize(s, (framesize_t)settings.framesize);
   s->set_brightness(s, settings.brightness);
   s->set_contrast(s, settings.contrast);
-  s->set_saturation(s, settings.saturation);
+  // Color mode needs chroma, so the B&W saturation setting is not applied
+  s->set_saturation(s, settings.colorMode ? 2 : settings.saturation);
   s->set_sharpness(s, settings.sharpness);
   s->set_ae_level(s, settings.ae_level);
   s->set_agc_gain(s, settings.agc_gain);
@@ -170,17 +1032,444 @@ void applyCameraSettings() {
   s->set_colorbar(s, 0);
 }
 
-// Convert grayscale image to 1-bit (binary) using threshold
-void convertTo1Bit(uint8_t* grayscale_buf, size_t len) {
+// Convert grayscale image to 1-bit (binary) using threshold. The mapping is
+// the same for both line colors (the analyzers pick the line value), so the
+// loop has no per-pixel branch.
+HOT_KERNEL void convertTo1Bit(uint8_t* grayscale_buf, size_t len) {
+  uint8_t threshold = binaryThreshold;
   for (size_t i = 0; i < len; i++) {
-    if (invertColors) {
-      // White line on black field
-      grayscale_buf[i] = (grayscale_buf[i] < binaryThreshold) ? 0 : 255;
+    grayscale_buf[i] = (grayscale_buf[i] < threshold) ? 0 : 255;
+  }
+}
+
+// convertTo1Bit from one buffer into another
+HOT_KERNEL void convertTo1BitInto(const uint8_t* grayscale_buf, uint8_t* binary_buf, size_t len) {
+  uint8_t threshold = binaryThreshold;
+  for (size_t i = 0; i < len; i++) {
+    binary_buf[i] = (grayscale_buf[i] < threshold) ? 0 : 255;
+  }
+}
+
+// Binarize the planned scanline rows straight from the grayscale frame into
+// internal SRAM and leave the rest of the frame to finishBinarization(): the
+// analyzers read no PSRAM, the tracer and corner check binarize the rows and
+// columns they visit, and the path is out before the whole-frame pass. Only
+// the plain threshold pipeline qualifies: the glare mask and the binary
+// filters need the whole frame first. Returns false when the caller has to
+// binarize (and filter) the frame itself.
+bool stageScanlineRows(uint8_t* grayscale_buf, size_t width, size_t height) {
+#if !LINE_SRAM_ROWS
+  (void)grayscale_buf;
+  (void)width;
+  (void)height;
+  return false;
+#else
+  if (!detectorFrameSupported(width, height) || selectDetectorPipeline()->glareMask ||
+      morphFilter != MORPH_NONE || temporalFilterFrames > 0) {
+    return false;
+  }
+  PROFILE_REGION(PROF_STAGE_ROWS);
+  for (int i = 0; i < stagedRowCount; i++) {
+    stagedRowSlot[stagedRowIndex[i]] = 0;
+  }
+  const ScanlinePlan* plan = planScanlines(width, height);
+  for (int i = 0; i < plan->count; i++) {
+    int row = plan->rows[i];
+    convertTo1BitInto(grayscale_buf + row * width, stagedRowData[i], width);
+    stagedRowIndex[i] = row;
+    stagedRowSlot[row] = i + 1;
+  }
+  stagedRowCount = plan->count;
+  stagedRowWidth = width;
+  stagedRowSequence = frameSequence;
+  stagedRowFrame = grayscale_buf;
+  stagedFrameHeight = height;
+  stagedFramePending = true;
+  return true;
+#endif
+}
+
+// Binarize the rest of the frame after stageScanlineRows(), for the /stream
+// overlay and JPEG
+void finishBinarization() {
+#if LINE_SRAM_ROWS
+  if (!stagedFramePending || stagedRowSequence != frameSequence) return;
+  PROFILE_REGION(PROF_BINARIZE);
+  // Runs of rows not binarized yet, one call each
+  int y = 0;
+  while (y < stagedFrameHeight) {
+    if (deferredRowDone[y] == frameSequence) {
+      y++;
+      continue;
+    }
+    int start = y;
+    while (y < stagedFrameHeight && deferredRowDone[y] != frameSequence) y++;
+    convertTo1Bit(stagedRowFrame + start * stagedRowWidth, (y - start) * stagedRowWidth);
+  }
+  stagedFramePending = false;
+#endif
+}
+
+// Arena bytes for one frame: packed rows, morphology scratch and packed
+// columns, plus the small tables and per-allocation alignment/red zones
+static size_t frameArenaBytes(size_t width, size_t height) {
+  size_t rowBytes = height * PACKED_WORDS(width) * sizeof(uint32_t);
+  size_t columnBytes = width * PACKED_WORDS(height) * sizeof(uint32_t);
+  return 2 * rowBytes + columnBytes + ARENA_SMALL_BYTES + 4 * (ARENA_ALIGN + ARENA_REDZONE);
+}
+
+// Size the arena for the frame geometry; a no-op unless the geometry
+// changed. Internal RAM if it fits, else PSRAM.
+bool ensureFrameArena(size_t width, size_t height) {
+  size_t capacity = frameArenaBytes(width, height);
+  if (frameArena.base != NULL && frameArena.capacity == capacity) return true;
+  
+  resetFrameArena();
+  if (frameArena.base != NULL) {
+    ARENA_UNPOISON(frameArena.base, frameArena.capacity);
+    free(frameArena.base);
+  }
+  frameArena.base = (uint8_t*)heap_caps_malloc(capacity, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (frameArena.base == NULL) {
+    frameArena.base = (uint8_t*)heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM);
+  }
+  frameArena.used = 0;
+  frameArena.highWater = 0;
+  if (frameArena.base == NULL) {
+    Serial.println("Failed to allocate frame arena");
+    frameArena.capacity = 0;
+    return false;
+  }
+  frameArena.capacity = capacity;
+  ARENA_POISON(frameArena.base, capacity);
+  return true;
+}
+
+// Start of a frame: everything allocated for the previous frame is gone,
+// including the packed frames
+void resetFrameArena() {
+  packedFrame = NULL;
+  packedColumns = NULL;
+  packedScratch = NULL;
+  packedWidth = 0;
+  packedHeight = 0;
+  transposedStrips = 0;
+  if (frameArena.base == NULL) return;
+  ARENA_POISON(frameArena.base, frameArena.used);
+  frameArena.used = 0;
+}
+
+void* arenaAlloc(size_t bytes) {
+  size_t offset = (frameArena.used + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (frameArena.base == NULL || bytes > frameArena.capacity || offset + bytes + ARENA_REDZONE > frameArena.capacity) {
+    frameArena.failures++;
+#if FRAME_ARENA_STRICT
+    Serial.printf("Frame arena exhausted: %u + %u > %u bytes\n", (unsigned)offset, (unsigned)bytes, (unsigned)frameArena.capacity);
+    abort();
+#endif
+    return NULL;
+  }
+  
+  uint8_t* p = frameArena.base + offset;
+  ARENA_UNPOISON(p, bytes);
+  frameArena.used = offset + bytes + ARENA_REDZONE;
+  if (frameArena.used > frameArena.highWater) {
+    frameArena.highWater = frameArena.used;
+  }
+  return p;
+}
+
+// Typed arena allocation of count elements (NULL when the arena is full)
+template <typename T>
+T* arenaAllocArray(size_t count) {
+  return (T*)arenaAlloc(count * sizeof(T));
+}
+
+void recordStageCycles(StageCycles& stage, uint32_t cycles) {
+  stage.last = cycles;
+  stage.mean = (stage.mean == 0) ? cycles : stage.mean - stage.mean / 16 + cycles / 16;
+}
+
+// Clear the region table and measure the cost of the counter reads themselves
+void resetProfileStats() {
+  memset(profileStats, 0, sizeof(profileStats));
+  uint32_t best = UINT32_MAX;
+  for (int i = 0; i < 16; i++) {
+    uint32_t start = profileCounter();
+    uint32_t cycles = profileCounter() - start;
+    if (cycles < best) best = cycles;
+  }
+  profileOverhead = best;
+}
+
+// Region table as JSON; regions that never ran are omitted
+size_t formatProfileJson(char* out, size_t size) {
+  size_t len = 0;
+  jsonAppend(out, size, len, "{\"enabled\":%s,\"unit\":\"%s\",\"overhead\":%lu,\"regions\":[",
+             LINE_PROFILE ? "true" : "false", PROFILE_UNIT, (unsigned long)profileOverhead);
+  bool first = true;
+  for (int r = 0; r < PROF_REGION_COUNT; r++) {
+    const ProfileStats& stats = profileStats[r];
+    if (stats.count == 0) continue;
+    jsonAppend(out, size, len, "%s{\"name\":\"%s\",\"count\":%lu,\"min\":%lu,\"mean\":%lu,\"max\":%lu}",
+               first ? "" : ",", profileRegionNames[r], (unsigned long)stats.count,
+               (unsigned long)stats.minCycles, (unsigned long)(stats.totalCycles / stats.count),
+               (unsigned long)stats.maxCycles);
+    first = false;
+  }
+  jsonAppend(out, size, len, "]}");
+  
+  if (len >= size) {
+    snprintf(out, size, "{\"error\":\"profile table too large\"}");
+    len = strlen(out);
+  }
+  return len;
+}
+
+bool initTraceRing() {
+  traceRing = (TraceEvent*)heap_caps_malloc(TRACE_RING_EVENTS * sizeof(TraceEvent), MALLOC_CAP_SPIRAM);
+  traceJsonBuffer = (char*)heap_caps_malloc(TRACE_JSON_SIZE, MALLOC_CAP_SPIRAM);
+  if (traceRing == NULL || traceJsonBuffer == NULL) {
+    free(traceRing);
+    free(traceJsonBuffer);
+    traceRing = NULL;
+    traceJsonBuffer = NULL;
+    return false;
+  }
+  traceHead = 0;
+  traceCount = 0;
+  return true;
+}
+
+// Task table index of the calling task (registered on first use)
+static int traceTaskIndex() {
+#if defined(__XTENSA__)
+  void* handle = xTaskGetCurrentTaskHandle();
+#else
+  void* handle = NULL;
+#endif
+  for (int t = 0; t < traceTaskCount; t++) {
+    if (traceTasks[t].handle == handle) return t;
+  }
+  if (traceTaskCount == TRACE_MAX_TASKS) return TRACE_MAX_TASKS - 1;
+  TraceTask& task = traceTasks[traceTaskCount];
+  task.handle = handle;
+#if defined(__XTENSA__)
+  strncpy(task.name, pcTaskGetTaskName(NULL), sizeof(task.name) - 1);
+#else
+  strncpy(task.name, "host", sizeof(task.name) - 1);
+#endif
+  task.name[sizeof(task.name) - 1] = '\0';
+  return traceTaskCount++;
+}
+
+void recordTraceEvent(uint8_t region, uint32_t startUs, uint32_t durationUs) {
+  if (traceRing == NULL || !traceEnabled) return;
+  TRACE_LOCK();
+  if (traceExporting) {
+    traceDropped++;
+  } else {
+    TraceEvent& event = traceRing[traceHead];
+    event.startUs = startUs;
+    event.durationUs = durationUs;
+    event.region = region;
+    event.task = traceTaskIndex();
+    traceHead = (traceHead + 1) % TRACE_RING_EVENTS;
+    if (traceCount < TRACE_RING_EVENTS) traceCount++;
+    traceRecorded++;
+  }
+  TRACE_UNLOCK();
+}
+
+// Events of the last windowUs as Chrome trace_event JSON (ts/dur in us since
+// boot, one thread per task). Recording pauses while the ring is read.
+size_t formatTraceJson(char* out, size_t size, uint32_t windowUs) {
+  size_t len = 0;
+  TRACE_LOCK();
+  traceExporting = true;
+  TRACE_UNLOCK();
+  
+  int64_t now = esp_timer_get_time();
+  uint32_t now32 = (uint32_t)now;
+  jsonAppend(out, size, len, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"recorded\":%lu,\"dropped\":%lu},\"traceEvents\":[",
+             (unsigned long)traceRecorded, (unsigned long)traceDropped);
+  jsonAppend(out, size, len, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"line-detector\"}}");
+  for (int t = 0; t < traceTaskCount; t++) {
+    jsonAppend(out, size, len, ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+               t, traceTasks[t].name);
+  }
+  // Oldest first; the 32-bit start times are widened relative to now
+  for (uint32_t k = 0; k < traceCount; k++) {
+    const TraceEvent& event = traceRing[(traceHead + TRACE_RING_EVENTS - traceCount + k) % TRACE_RING_EVENTS];
+    uint32_t age = now32 - event.startUs;
+    if (age > windowUs) continue;
+    jsonAppend(out, size, len, ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lu}",
+               profileRegionNames[event.region], event.task, (long long)(now - age),
+               (unsigned long)event.durationUs);
+  }
+  jsonAppend(out, size, len, "]}");
+  
+  TRACE_LOCK();
+  traceExporting = false;
+  TRACE_UNLOCK();
+  
+  if (len >= size) {
+    snprintf(out, size, "{\"error\":\"trace too large\"}");
+    len = strlen(out);
+  }
+  return len;
+}
+
+// Build the (U, V) -> color class lookup table from hue sectors
+void initColorDetection() {
+  // Hue of saturated colors in the U/V plane (degrees, atan2(V-128, U-128))
+  struct HueSector {
+    uint8_t colorClass;
+    float centerDeg;
+    float halfWidthDeg;
+  };
+  const HueSector sectors[] = {
+    {COLOR_RED,     109.0, 35.0},
+    {COLOR_YELLOW,  171.0, 25.0},
+    {COLOR_GREEN,  -128.0, 35.0},
+    {COLOR_BLUE,     -9.0, 35.0},
+  };
+  const int levels = 1 << UV_LUT_BITS;
+  const int step = 256 / levels;
+  
+  for (int ui = 0; ui < levels; ui++) {
+    for (int vi = 0; vi < levels; vi++) {
+      // Classify the center of the quantization cell
+      float u = ui * step + step / 2 - 128;
+      float v = vi * step + step / 2 - 128;
+      uint8_t colorClass = COLOR_NONE;
+      
+      if (sqrt(u * u + v * v) >= COLOR_MIN_SATURATION) {
+        float hue = atan2(v, u) * 180.0 / 3.14159;
+        for (size_t k = 0; k < sizeof(sectors) / sizeof(sectors[0]); k++) {
+          float diff = fabs(hue - sectors[k].centerDeg);
+          if (diff > 180.0) diff = 360.0 - diff;
+          if (diff <= sectors[k].halfWidthDeg) {
+            colorClass = sectors[k].colorClass;
+            break;
+          }
+        }
+      }
+      uvClassLut[(ui << UV_LUT_BITS) | vi] = colorClass;
+    }
+  }
+  
+  // Frame-sized planes for YUV422 mode (no allocation while streaming)
+  size_t maxPixels = PACKED_MAX_WIDTH * PACKED_MAX_HEIGHT;
+  lumaBuffer = (uint8_t*)heap_caps_malloc(maxPixels, MALLOC_CAP_SPIRAM);
+  colorClassMap = (uint8_t*)heap_caps_malloc(maxPixels / 2, MALLOC_CAP_SPIRAM);
+  if (lumaBuffer == NULL || colorClassMap == NULL) {
+    Serial.println("Color detection buffer allocation failed");
+  }
+}
+
+// Split a YUYV frame into the luma plane and per-pair color classes in a
+// single pass, accumulating marker statistics on the way
+void deinterleaveYUV422(const uint8_t* yuv_buf, size_t width, size_t height) {
+  int sumX[COLOR_CLASS_COUNT] = {0};
+  int sumY[COLOR_CLASS_COUNT] = {0};
+  int count[COLOR_CLASS_COUNT] = {0};
+  
+  const uint8_t* src = yuv_buf;
+  uint8_t* luma = lumaBuffer;
+  uint8_t* classes = colorClassMap;
+  
+  for (int y = 0; y < (int)height; y++) {
+    for (int x = 0; x < (int)width; x += 2) {
+      // Byte order: Y0 U Y1 V
+      luma[0] = src[0];
+      luma[1] = src[2];
+      uint8_t colorClass = uvClassLut[((src[1] >> (8 - UV_LUT_BITS)) << UV_LUT_BITS) | (src[3] >> (8 - UV_LUT_BITS))];
+      *classes++ = colorClass;
+      count[colorClass]++;
+      sumX[colorClass] += x;
+      sumY[colorClass] += y;
+      luma += 2;
+      src += 4;
+    }
+  }
+  
+  int minPixels = (width / 2) * height * COLOR_MIN_PIXELS_PERCENT / 100;
+  for (int c = 0; c < COLOR_CLASS_COUNT; c++) {
+    colorMarkers[c].pixelCount = count[c];
+    if (c != COLOR_NONE && count[c] > 0 && count[c] >= minPixels) {
+      colorMarkers[c].centerX = sumX[c] / count[c] + 1; // Center of the pixel pair
+      colorMarkers[c].centerY = sumY[c] / count[c];
     } else {
-      // Black line on white field
-      grayscale_buf[i] = (grayscale_buf[i] < binaryThreshold) ? 0 : 255;
+      colorMarkers[c].centerX = -1;
+      colorMarkers[c].centerY = -1;
+    }
+  }
+}
+
+// Grayscale view of a captured frame: the buffer itself for grayscale,
+// the deinterleaved luma plane for YUV422, NULL for other formats
+uint8_t* lumaFromFrame(camera_fb_t* fb) {
+  if (fb->format == PIXFORMAT_GRAYSCALE) {
+    return fb->buf;
+  }
+  if (fb->format == PIXFORMAT_YUV422 && lumaBuffer != NULL && colorClassMap != NULL &&
+      fb->width <= PACKED_MAX_WIDTH && fb->height <= PACKED_MAX_HEIGHT) {
+    deinterleaveYUV422(fb->buf, fb->width, fb->height);
+    return lumaBuffer;
+  }
+  return NULL;
+}
+
+// Binarize and build the glare mask in the same pass: runs of at least
+// 3 pixels at or above glareLevel are marked in glareMask
+HOT_KERNEL void convertTo1BitWithGlareMask(uint8_t* grayscale_buf, size_t width, size_t height) {
+  if (width > PACKED_MAX_WIDTH || height > PACKED_MAX_HEIGHT) {
+    convertTo1Bit(grayscale_buf, width * height);
+    return;
+  }
+  
+  int words = PACKED_WORDS(width);
+  uint8_t level = glareLevel;
+  glarePixelCount = 0;
+  
+  for (int y = 0; y < (int)height; y++) {
+    uint8_t* rowPtr = grayscale_buf + y * width;
+    uint32_t* maskRow = glareMask + y * words;
+    
+    // Clipped pixels as bits, binarizing the same bytes
+    for (int w = 0; w < words; w++) {
+      int x0 = w * 32;
+      int count = ((int)width - x0 < 32) ? (int)width - x0 : 32;
+      uint32_t clipped = 0;
+      for (int b = 0; b < count; b++) {
+        uint8_t pixel = rowPtr[x0 + b];
+        clipped |= (uint32_t)(pixel >= level) << b;
+        rowPtr[x0 + b] = (pixel < binaryThreshold) ? 0 : 255;
+      }
+      maskRow[w] = clipped;
+    }
+    
+    // Keep only runs of 3 or more: a bit survives if it starts,
+    // sits inside or ends a run of three. Neighbouring words supply the carries.
+    uint32_t prev = 0;
+    uint32_t cur = maskRow[0];
+    for (int w = 0; w < words; w++) {
+      uint32_t next = (w + 1 < words) ? maskRow[w + 1] : 0;
+      uint32_t right1 = (cur >> 1) | (next << 31);
+      uint32_t right2 = (cur >> 2) | (next << 30);
+      uint32_t left1 = (cur << 1) | (prev >> 31);
+      uint32_t left2 = (cur << 2) | (prev >> 30);
+      uint32_t runs = cur & ((right1 & right2) | (left1 & right1) | (left1 & left2));
+      prev = cur;
+      cur = next;
+      maskRow[w] = runs;
+      glarePixelCount += __builtin_popcount(runs);
     }
   }
+  
+  glareMaskWidth = width;
+  glareMaskSequence = frameSequence;
 }
 
 // Auto-calibrate camera threshold by analyzing the histogram
@@ -199,8 +1488,9 @@ void calibrateCamera() {
     return;
   }
   
-  if (fb->format != PIXFORMAT_GRAYSCALE) {
-    Serial.println("Expected grayscale format");
+  uint8_t* gray = lumaFromFrame(fb);
+  if (gray == NULL) {
+    Serial.println("Expected grayscale or YUV422 format");
     esp_camera_fb_return(fb);
     // digitalWrite(LED_FLASH, LOW);
     return;
@@ -208,8 +1498,9 @@ void calibrateCamera() {
   
   // Build histogram
   int histogram[256] = {0};
-  for (size_t i = 0; i < fb->len; i++) {
-    histogram[fb->buf[i]]++;
+  size_t len = fb->width * fb->height;
+  for (size_t i = 0; i < len; i++) {
+    histogram[gray[i]]++;
   }
   
   // Find peaks in histogram (bimodal distribution for line and field)
@@ -245,15 +1536,15 @@ void calibrateCamera() {
     
     // Sample top and bottom rows
     for (int x = 0; x < width; x++) {
-      edgeSum += fb->buf[x]; // Top row
-      edgeSum += fb->buf[(height-1) * width + x]; // Bottom row
+      edgeSum += gray[x]; // Top row
+      edgeSum += gray[(height-1) * width + x]; // Bottom row
       edgeCount += 2;
     }
     
     // Sample left and right columns
     for (int y = 1; y < height-1; y++) {
-      edgeSum += fb->buf[y * width]; // Left column
-      edgeSum += fb->buf[y * width + (width-1)]; // Right column
+      edgeSum += gray[y * width]; // Left column
+      edgeSum += gray[y * width + (width-1)]; // Right column
       edgeCount += 2;
     }
     
@@ -264,6 +1555,10 @@ void calibrateCamera() {
     
     Serial.printf("Calibration complete: threshold=%d, peak1=%d, peak2=%d, invertColors=%d\n", 
                   binaryThreshold, peak1Idx, peak2Idx, invertColors);
+    
+    // Frames binarized with the old threshold are no longer comparable
+    resetTemporalFilter();
+    fieldLevel = -1; // Relearn the field level for the new threshold
   } else {
     Serial.println("Calibration failed: could not find two peaks");
   }
@@ -272,102 +1567,1027 @@ void calibrateCamera() {
   // digitalWrite(LED_FLASH, LOW);
 }
 
-// Analyze a single horizontal scanline
-ScanlineResult analyzeScanline(uint8_t* grayscale_buf, size_t width, int row) {
-  ScanlineResult result;
-  result.state = SCANLINE_UNDEFINED;
-  result.transitionStart = -1;
-  result.transitionEnd = -1;
-  result.blackPixelCount = 0;
-  
-  uint8_t lineColor = invertColors ? 255 : 0; // What color the line should be
-  
-  int firstBlackPixel = -1;
-  int lastBlackPixel = -1;
-  bool inLine = false;
-  int transitionCount = 0; // Count how many times we transition
-  
-  // Scan the entire row
-  for (int x = 0; x < width; x++) {
-    uint8_t pixel = grayscale_buf[row * width + x];
+// Row scan policy: the line value and glare masking are template
+// parameters, so each instantiation's pixel loop has no configuration branch.
+// Fills the run fields of result; masked pixels are unknown and neither extend
+// nor end a run.
+template <uint8_t LineColor>
+struct RowScanner {
+  template <bool Masked>
+  static HOT_KERNEL void scan(const uint8_t* rowPtr, const uint32_t* maskRow, size_t width,
+                              ScanlineResult& result, RowScan& out) {
+    // Locals only inside the loop: stores through result could alias rowPtr
+    int firstLinePixel = -1;
+    int lastLinePixel = -1;
+    int firstRunEnd = -1;
+    int lastRunStart = -1;
+    int lastRunEnd = -1;
+    bool inLine = false;
+    int linePixelCount = 0;
+    int transitionCount = 0;
+    int maskedCount = 0;
     
-    if (pixel == lineColor) {
-      result.blackPixelCount++;
-      
-      if (firstBlackPixel == -1) {
-        firstBlackPixel = x;
+    for (int x = 0; x < (int)width; x++) {
+      if (Masked && ((maskRow[x >> 5] >> (x & 31)) & 1)) {
+        maskedCount++;
+        continue;
       }
-      lastBlackPixel = x;
       
-      if (!inLine) {
-        inLine = true;
-        transitionCount++;
-        if (result.transitionStart == -1) {
-          result.transitionStart = x;
+      if (rowPtr[x] == LineColor) {
+        linePixelCount++;
+        if (firstLinePixel == -1) {
+          firstLinePixel = x;
         }
-      }
-    } else {
-      if (inLine) {
+        lastLinePixel = x;
+        
+        if (!inLine) {
+          inLine = true;
+          transitionCount++;
+          lastRunStart = x;
+        }
+      } else if (inLine) {
         inLine = false;
-        if (result.transitionEnd == -1) {
-          result.transitionEnd = lastBlackPixel;
+        lastRunEnd = lastLinePixel;
+        if (firstRunEnd == -1) {
+          firstRunEnd = lastLinePixel;
         }
       }
     }
-  }
-  
-  // Determine the state of the scanline
-  float blackRatio = (float)result.blackPixelCount / width;
-  
-  if (blackRatio < 0.05) {
-    // Less than 5% black pixels - completely white
-    result.state = SCANLINE_WHITE;
-  } else if (blackRatio > 0.95) {
-    // More than 95% black pixels - completely black (on the line)
-    result.state = SCANLINE_BLACK;
-  } else if (firstBlackPixel != -1 && lastBlackPixel != -1) {
-    // Check if it looks like a line crossing
-    int lineWidth = lastBlackPixel - firstBlackPixel + 1;
-    int expectedMin = EXPECTED_LINE_WIDTH - LINE_WIDTH_THRESHOLD;
-    int expectedMax = EXPECTED_LINE_WIDTH + LINE_WIDTH_THRESHOLD;
     
-    if (lineWidth >= expectedMin && lineWidth <= expectedMax) {
-      // Line width matches expected width - crossed by line
-      result.state = SCANLINE_CROSSED;
-      result.transitionStart = firstBlackPixel;
-      result.transitionEnd = lastBlackPixel;
-    } else {
-      // Black pixels present but doesn't match expected line width
-      result.state = SCANLINE_UNDEFINED;
+    // Close a run that reaches the right edge
+    if (inLine) {
+      lastRunEnd = lastLinePixel;
+      if (firstRunEnd == -1) {
+        firstRunEnd = lastLinePixel;
+      }
     }
-  } else {
-    result.state = SCANLINE_UNDEFINED;
+    result.blackPixelCount = linePixelCount;
+    result.transitionStart = firstLinePixel;
+    result.transitionEnd = firstRunEnd;
+    result.lastRunStart = lastRunStart;
+    result.lastRunEnd = lastRunEnd;
+    result.runCount = transitionCount;
+    out.firstLinePixel = firstLinePixel;
+    out.lastLinePixel = lastLinePixel;
+    out.maskedCount = maskedCount;
   }
   
-  return result;
-}
+  // Pack a row to 1 bit per pixel, bit set = line color. Glare is never line.
+  static HOT_KERNEL void pack(const uint8_t* rowPtr, const uint32_t* maskRow, size_t width, uint32_t* out) {
+    int words = PACKED_WORDS(width);
+    for (int w = 0; w < words; w++) {
+      int x0 = w * 32;
+      int count = ((int)width - x0 < 32) ? (int)width - x0 : 32;
+      uint32_t word = 0;
+      for (int b = 0; b < count; b++) {
+        word |= (uint32_t)(rowPtr[x0 + b] == LineColor) << b;
+      }
+      out[w] = maskRow ? (word & ~maskRow[w]) : word;
+    }
+  }
+};
 
-// New line detection using 4 scanning lines approach
-void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t height) {
-  // Reset detection values
-  lineCenterX = -1;
-  lineCenterTop = -1;
-  lineCenterMiddle = -1;
-  lineCenterBottom = -1;
-  
-  // Define 4 initial scanning lines with 5-pixel offset from edges
-  const int EDGE_OFFSET = 5;
-  int scanlines[4];
-  scanlines[0] = EDGE_OFFSET;                    // Top scanline
-  scanlines[1] = height / 3;                      // Upper-middle scanline
-  scanlines[2] = (2 * height) / 3;               // Lower-middle scanline
-  scanlines[3] = height - EDGE_OFFSET - 1;       // Bottom scanline
+// Binarizer policies
+struct ThresholdBinarizer {
+  static void run(uint8_t* buf, size_t width, size_t height) {
+    PROFILE_REGION(PROF_BINARIZE);
+    convertTo1Bit(buf, width * height);
+  }
+};
+
+struct GlareMaskBinarizer {
+  static void run(uint8_t* buf, size_t width, size_t height) {
+    PROFILE_REGION(PROF_BINARIZE);
+    convertTo1BitWithGlareMask(buf, width, height);
+  }
+};
+
+// Fuser policy: scanline states to region centers (also runs the tracer,
+// corner check, confidence and path)
+struct ScanlineFuser {
+  static void run(uint8_t* buf, size_t width, size_t height) {
+    detectLineCenterWithScanlines(buf, width, height);
+  }
+};
+
+// Curve estimator policy: angle and turn direction from region centers
+struct RegionCurveEstimator {
+  static void run(size_t width) {
+    detectCurveAndTurn(width);
+  }
+};
+
+// A detector configuration composed from policies at compile time
+template <class Binarizer, class RowAnalyzer, class Fuser, class CurveEstimator>
+struct LineDetector {
+  static constexpr DetectorPipeline pipeline(const char* name, uint8_t lineColor, bool glareMask) {
+    return DetectorPipeline{name, lineColor, glareMask, &Binarizer::run,
+                            &RowAnalyzer::template scan<false>, &RowAnalyzer::template scan<true>,
+                            &RowAnalyzer::pack, &Fuser::run, &CurveEstimator::run};
+  }
+};
+
+// Registry of prebuilt detector instantiations, selected per frame from the
+// runtime settings by selectDetectorPipeline()
+const DetectorPipeline detectorPipelines[] = {
+  LineDetector<ThresholdBinarizer, RowScanner<0>, ScanlineFuser, RegionCurveEstimator>::pipeline("black-line", 0, false),
+  LineDetector<ThresholdBinarizer, RowScanner<255>, ScanlineFuser, RegionCurveEstimator>::pipeline("white-line", 255, false),
+  LineDetector<GlareMaskBinarizer, RowScanner<0>, ScanlineFuser, RegionCurveEstimator>::pipeline("black-line-glare", 0, true),
+  LineDetector<GlareMaskBinarizer, RowScanner<255>, ScanlineFuser, RegionCurveEstimator>::pipeline("white-line-glare", 255, true),
+};
+const int DETECTOR_PIPELINE_COUNT = sizeof(detectorPipelines) / sizeof(detectorPipelines[0]);
+
+const DetectorPipeline* selectDetectorPipeline() {
+  uint8_t lineColor = invertColors ? 255 : 0;
+  for (int i = 0; i < DETECTOR_PIPELINE_COUNT; i++) {
+    if (detectorPipelines[i].lineColor == lineColor && detectorPipelines[i].glareMask == glareMaskEnabled) {
+      activeDetectorPipeline = &detectorPipelines[i];
+      break;
+    }
+  }
+  return activeDetectorPipeline;
+}
+
+// Analyze a single horizontal scanline
+HOT_KERNEL ScanlineResult analyzeScanline(uint8_t* grayscale_buf, size_t width, size_t height, int row) {
+  PROFILE_REGION(PROF_SCANLINE);
+  ScanlineResult result;
+  result.state = SCANLINE_UNDEFINED;
+  result.transitionStart = -1;
+  result.transitionEnd = -1;
+  result.blackPixelCount = 0;
+  result.runCount = 0;
+  result.lastRunStart = -1;
+  result.lastRunEnd = -1;
+  
+  // Rows outside the frame (odd plans, future ROI modes) stay undefined
+  if (row < 0 || row >= (int)height) {
+    return result;
+  }
+  
+  // Wide rows: localize on the coarse level, refine only around the hit
+  // (lane mode needs both boundary runs, so it always scans flat)
+  if (!laneModeEnabled && pyramidFactor > 1 && width >= PYRAMID_MIN_WIDTH) {
+    return analyzeScanlineCoarseToFine(grayscale_buf, width, row);
+  }
+  
+  const uint8_t* rowPtr = scanlineRowPtr(grayscale_buf, width, row);
+  const uint32_t* maskRow = glareMaskRow(width, row);
+  
+  // Pixel loop of the selected pipeline, specialized for line color and masking
+  RowScan scan;
+  if (maskRow) {
+    activeDetectorPipeline->scanMaskedRow(rowPtr, maskRow, width, result, scan);
+  } else {
+    activeDetectorPipeline->scanRow(rowPtr, maskRow, width, result, scan);
+  }
+  int firstBlackPixel = scan.firstLinePixel;
+  int lastBlackPixel = scan.lastLinePixel;
+  int transitionCount = result.runCount;
+  int maskedCount = scan.maskedCount;
+  
+  if (maskedCount >= (int)width) {
+    return result; // Whole row under glare - undefined
+  }
+  
+  // Ratios only count known pixels
+  if (laneModeEnabled) {
+    classifyLaneScanline(result, width, width - maskedCount, row);
+    return result;
+  }
+  
+  int expectedWidth = expectedLineWidthForRow(row);
+  classifyScanline(result, width - maskedCount, firstBlackPixel, lastBlackPixel, expectedWidth);
+  
+  // Glare touching the run may hide part of the line: retry with the
+  // adjacent masked pixels counted as line
+  if (maskedCount > 0 && result.state == SCANLINE_UNDEFINED && firstBlackPixel != -1) {
+    int lo = firstBlackPixel;
+    int hi = lastBlackPixel;
+    while (lo > 0 && ((maskRow[(lo - 1) >> 5] >> ((lo - 1) & 31)) & 1)) lo--;
+    while (hi < (int)width - 1 && ((maskRow[(hi + 1) >> 5] >> ((hi + 1) & 31)) & 1)) hi++;
+    if (lo != firstBlackPixel || hi != lastBlackPixel) {
+      classifyScanline(result, width - maskedCount, lo, hi, expectedWidth);
+    }
+  }
+  
+  if (maskedCount == 0) {
+    learnLineWidth(row, firstBlackPixel, lastBlackPixel, transitionCount, width);
+  }
+  return result;
+}
+
+// Expected line width for a row: learned median once enough samples exist,
+// otherwise the constant scaled to the frame width
+int expectedLineWidthForRow(int row) {
+  if (lineWidthLearningEnabled && row >= 0 && row < MAX_FRAME_ROWS &&
+      widthSampleCount[row] >= LEARN_WIDTH_MIN_SAMPLES) {
+    return learnedLineWidth[row];
+  }
+  return frameLineWidth;
+}
+
+// Add a confident width sample to the row's ring and update its median.
+// Confident = a single run fully inside the frame and within twice the
+// tolerance of the frame's constant width. The gate is the constant, not the
+// learned width: gated on its own median, the table could walk away step by
+// step (a widening blob, a second line merging in) with no bound at all.
+void learnLineWidth(int row, int firstBlackPixel, int lastBlackPixel, int runCount, size_t width) {
+  if (!lineWidthLearningEnabled || row < 0 || row >= MAX_FRAME_ROWS) return;
+  if (runCount != 1 || firstBlackPixel <= 0 || lastBlackPixel >= (int)width - 1) return;
+  
+  int lineWidth = lastBlackPixel - firstBlackPixel + 1;
+  if (lineWidth < frameLineWidth - 2 * frameLineTolerance || lineWidth > frameLineWidth + 2 * frameLineTolerance) return;
+  if (lineWidth > 255) return;
+  
+  widthSamples[row][widthSampleHead[row]] = lineWidth;
+  widthSampleHead[row] = (widthSampleHead[row] + 1) % LEARN_WIDTH_SAMPLES;
+  if (widthSampleCount[row] < LEARN_WIDTH_SAMPLES) widthSampleCount[row]++;
+  
+  // Median by insertion sort of at most LEARN_WIDTH_SAMPLES values
+  uint8_t sorted[LEARN_WIDTH_SAMPLES];
+  int n = widthSampleCount[row];
+  for (int i = 0; i < n; i++) {
+    uint8_t v = widthSamples[row][i];
+    int j = i;
+    while (j > 0 && sorted[j - 1] > v) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+  learnedLineWidth[row] = sorted[n / 2];
+}
+
+void resetLearnedLineWidths() {
+  for (int i = 0; i < MAX_FRAME_ROWS; i++) {
+    widthSampleCount[i] = 0;
+    widthSampleHead[i] = 0;
+    learnedLineWidth[i] = 0;
+  }
+}
+
+// Forget learned lane widths and centers
+void resetLaneModel() {
+  for (int i = 0; i < MAX_FRAME_ROWS; i++) {
+    laneWidthByRow[i] = 0;
+    laneCenterByRow[i] = -1;
+  }
+  laneWidthBottom = 0;
+}
+
+// Check a boundary run against the expected line width; runs cut by the
+// frame border only need half the width
+static bool isBoundaryRun(int start, int end, size_t width) {
+  if (start < 0 || end < start) return false;
+  int runWidth = end - start + 1;
+  int expectedMin = frameLineWidth - frameLineTolerance;
+  int expectedMax = frameLineWidth + frameLineTolerance;
+  bool clipped = (start == 0 || end == (int)width - 1);
+  return runWidth <= expectedMax && (runWidth >= expectedMin || (clipped && runWidth >= expectedMin / 2));
+}
+
+// Lane mode classification from the first and last runs of the row pass.
+// CROSSED rows get transitionStart/End at the two boundary centers, so the
+// usual (start + end) / 2 gives the lane center. knownPixels is the row
+// width less the glare-masked pixels.
+void classifyLaneScanline(ScanlineResult& result, size_t width, int knownPixels, int row) {
+  result.state = SCANLINE_UNDEFINED;
+  
+  float blackRatio = (float)result.blackPixelCount / knownPixels;
+  if (blackRatio > 0.95) {
+    result.state = SCANLINE_BLACK;
+    return;
+  }
+  if (result.runCount == 0 || row < 0 || row >= MAX_FRAME_ROWS) {
+    result.state = SCANLINE_WHITE;
+    return;
+  }
+  
+  int firstStart = result.transitionStart;
+  int firstEnd = result.transitionEnd;
+  int leftCenter = -1;
+  int rightCenter = -1;
+  
+  if (result.runCount >= 2 &&
+      isBoundaryRun(firstStart, firstEnd, width) &&
+      isBoundaryRun(result.lastRunStart, result.lastRunEnd, width)) {
+    // Both boundaries visible: measure and learn the lane width
+    leftCenter = (firstStart + firstEnd) / 2;
+    rightCenter = (result.lastRunStart + result.lastRunEnd) / 2;
+    int measured = rightCenter - leftCenter;
+    int learned = laneWidthByRow[row];
+    laneWidthByRow[row] = (learned == 0) ? measured : (3 * learned + measured) / 4;
+  } else if (result.runCount == 1 && isBoundaryRun(firstStart, firstEnd, width) && laneWidthByRow[row] > 0) {
+    // One boundary missing: extrapolate it from the learned lane width,
+    // deciding the side from the previous lane center in this row
+    int runCenter = (firstStart + firstEnd) / 2;
+    int previousCenter = (laneCenterByRow[row] >= 0) ? laneCenterByRow[row] : (int)width / 2;
+    if (runCenter < previousCenter) {
+      leftCenter = runCenter;
+      rightCenter = runCenter + laneWidthByRow[row];
+    } else {
+      rightCenter = runCenter;
+      leftCenter = runCenter - laneWidthByRow[row];
+    }
+    laneBoundaryMissing = true;
+  } else {
+    return;
+  }
+  
+  int laneCenter = (leftCenter + rightCenter) / 2;
+  if (laneCenter < 0 || laneCenter >= (int)width) return;
+  
+  laneCenterByRow[row] = laneCenter;
+  result.state = SCANLINE_CROSSED;
+  result.transitionStart = leftCenter;
+  result.transitionEnd = rightCenter;
+}
+
+// Two-level pyramid scan of a row: the coarse level samples every
+// pyramidFactor-th pixel across the whole row, then the line edges and
+// pixel count are refined at full resolution only in a band around the
+// coarse hit. Cost is width/factor + line width instead of width.
+HOT_KERNEL ScanlineResult analyzeScanlineCoarseToFine(uint8_t* grayscale_buf, size_t width, int row) {
+  ScanlineResult result;
+  result.state = SCANLINE_UNDEFINED;
+  result.transitionStart = -1;
+  result.transitionEnd = -1;
+  result.blackPixelCount = 0;
+  result.runCount = 0;
+  result.lastRunStart = -1;
+  result.lastRunEnd = -1;
+  
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  const uint8_t* rowPtr = scanlineRowPtr(grayscale_buf, width, row);
+  const uint32_t* maskRow = glareMaskRow(width, row);
+  int factor = pyramidFactor;
+  
+  // Coarse level: downsampled row
+  int coarseSamples = 0;
+  int coarseCount = 0;
+  int coarseFirst = -1;
+  int coarseLast = -1;
+  int coarseRuns = 0;
+  bool masked = false;
+  for (int x = factor / 2; x < (int)width; x += factor) {
+    if (maskRow && ((maskRow[x >> 5] >> (x & 31)) & 1)) {
+      masked = true;
+      continue;
+    }
+    coarseSamples++;
+    if (rowPtr[x] == lineColor) {
+      coarseCount++;
+      if (coarseFirst == -1) coarseFirst = x;
+      if (coarseLast != x - factor) coarseRuns++;
+      coarseLast = x;
+    }
+  }
+  
+  if (coarseSamples == 0) {
+    return result; // Whole row under glare - undefined
+  }
+  
+  float coarseRatio = (float)coarseCount / coarseSamples;
+  if (coarseRatio < 0.05) {
+    result.state = SCANLINE_WHITE;
+    result.blackPixelCount = coarseCount * factor;
+    return result;
+  }
+  if (coarseRatio > 0.95) {
+    result.state = SCANLINE_BLACK;
+    result.blackPixelCount = coarseCount * factor;
+    return result;
+  }
+  
+  // Fine level: full resolution band around the coarse hit
+  int bandStart = coarseFirst - factor + 1;
+  int bandEnd = coarseLast + factor - 1;
+  if (bandStart < 0) bandStart = 0;
+  if (bandEnd > (int)width - 1) bandEnd = width - 1;
+  
+  int firstBlackPixel = -1;
+  int lastBlackPixel = -1;
+  int fineRuns = 0;
+  for (int x = bandStart; x <= bandEnd; x++) {
+    if (maskRow && ((maskRow[x >> 5] >> (x & 31)) & 1)) {
+      masked = true;
+      continue;
+    }
+    if (rowPtr[x] == lineColor) {
+      result.blackPixelCount++;
+      if (firstBlackPixel == -1) firstBlackPixel = x;
+      if (lastBlackPixel != x - 1) fineRuns++;
+      lastBlackPixel = x;
+    }
+  }
+  result.transitionStart = firstBlackPixel;
+  // Runs the coarse level split apart are separate even if the band missed the gap
+  result.runCount = (coarseRuns > 1) ? coarseRuns : fineRuns;
+  
+  // Masked share of the row is estimated from the coarse level
+  int knownWidth = coarseSamples * factor;
+  classifyScanline(result, (knownWidth < (int)width) ? knownWidth : width, firstBlackPixel, lastBlackPixel,
+                   expectedLineWidthForRow(row));
+  
+  // Same confident-sample rule as the flat scan, so the width table keeps
+  // learning when the pyramid is on
+  if (!masked) {
+    learnLineWidth(row, firstBlackPixel, lastBlackPixel, result.runCount, width);
+  }
+  return result;
+}
+
+// Determine the state of a scanline from its dark pixel statistics
+// (shared by horizontal rows and vertical columns)
+HOT_KERNEL void classifyScanline(ScanlineResult& result, size_t length, int firstBlackPixel, int lastBlackPixel, int expectedWidth) {
+  float blackRatio = (float)result.blackPixelCount / length;
+  
+  if (blackRatio < 0.05) {
+    // Less than 5% black pixels - completely white
+    result.state = SCANLINE_WHITE;
+  } else if (blackRatio > 0.95) {
+    // More than 95% black pixels - completely black (on the line)
+    result.state = SCANLINE_BLACK;
+  } else if (firstBlackPixel != -1 && lastBlackPixel != -1) {
+    // Check if it looks like a line crossing
+    int lineWidth = lastBlackPixel - firstBlackPixel + 1;
+    int expectedMin = expectedWidth - frameLineTolerance;
+    int expectedMax = expectedWidth + frameLineTolerance;
+    
+    if (lineWidth >= expectedMin && lineWidth <= expectedMax) {
+      // Line width matches expected width - crossed by line
+      result.state = SCANLINE_CROSSED;
+      result.transitionStart = firstBlackPixel;
+      result.transitionEnd = lastBlackPixel;
+    } else {
+      // Black pixels present but doesn't match expected line width
+      result.state = SCANLINE_UNDEFINED;
+    }
+  } else {
+    result.state = SCANLINE_UNDEFINED;
+  }
+}
+
+// Pack a binarized frame into 1 bit per pixel (set = line color)
+bool packBinaryFrame(const uint8_t* binary_buf, size_t width, size_t height) {
+  if (width > PACKED_MAX_WIDTH || height > PACKED_MAX_HEIGHT) {
+    packedWidth = 0;
+    packedHeight = 0;
+    return false;
+  }
+  
+  // Buffers live in the frame arena; repacking within a frame reuses them
+  if (packedFrame == NULL || packedAllocWidth != (int)width || packedAllocHeight != (int)height) {
+    packedAllocWidth = width;
+    packedAllocHeight = height;
+    packedFrame = arenaAllocArray<uint32_t>(height * PACKED_WORDS(width));
+    packedScratch = arenaAllocArray<uint32_t>(height * PACKED_WORDS(width));
+    packedColumns = arenaAllocArray<uint32_t>(width * PACKED_WORDS(height));
+    if (packedFrame == NULL || packedScratch == NULL || packedColumns == NULL) {
+      packedFrame = NULL;
+      packedWidth = 0;
+      packedHeight = 0;
+      return false;
+    }
+  }
+  
+  packedWidth = width;
+  packedHeight = height;
+  packedRowWords = PACKED_WORDS(width);
+  transposedStrips = 0;
+  packedFrameSequence = frameSequence;
+  
+  // Bit loop of the selected pipeline, specialized for the line color
+  RowPackFn packRow = activeDetectorPipeline->packRow;
+  for (int y = 0; y < packedHeight; y++) {
+    packRow(binary_buf + y * width, glareMaskRow(width, y), width, packedFrame + y * packedRowWords);
+  }
+  return true;
+}
+
+// Write the packed frame back as a binarized byte frame (line color / field color)
+void unpackBinaryFrame(uint8_t* binary_buf) {
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  uint8_t fieldColor = 255 - lineColor;
+  
+  for (int y = 0; y < packedHeight; y++) {
+    const uint32_t* src = packedFrame + y * packedRowWords;
+    uint8_t* dst = binary_buf + y * packedWidth;
+    for (int x = 0; x < packedWidth; x++) {
+      dst[x] = ((src[x >> 5] >> (x & 31)) & 1) ? lineColor : fieldColor;
+    }
+  }
+}
+
+// 3-tap horizontal AND (erode) or OR (dilate) of one packed row using word
+// shifts with carries from the neighbouring words. Pixels outside the frame
+// do not constrain the result.
+static void morphRow3(const uint32_t* in, uint32_t* out, int words, bool erode) {
+  uint32_t pad = erode ? 0xFFFFFFFF : 0;
+  int tailBits = packedWidth & 31;
+  uint32_t lastMask = tailBits ? ((1u << tailBits) - 1) : 0xFFFFFFFF;
+  
+  uint32_t prev = pad;
+  uint32_t cur = in[0];
+  for (int i = 0; i < words; i++) {
+    bool last = (i == words - 1);
+    if (last && erode) cur |= ~lastMask;
+    uint32_t next = last ? pad : in[i + 1];
+    if (i + 1 == words - 1 && erode) next |= ~lastMask;
+    
+    uint32_t left = (cur << 1) | (prev >> 31);  // Pixel x-1 moved to x
+    uint32_t right = (cur >> 1) | (next << 31); // Pixel x+1 moved to x
+    out[i] = erode ? (cur & left & right) : (cur | left | right);
+    
+    prev = cur;
+    cur = next;
+  }
+  out[words - 1] &= lastMask;
+}
+
+// 3x3 erosion or dilation of packedFrame (separable: rows, then columns)
+static void morphPacked3x3(bool erode) {
+  int words = packedRowWords;
+  
+  // Horizontal pass into scratch
+  for (int y = 0; y < packedHeight; y++) {
+    morphRow3(packedFrame + y * words, packedScratch + y * words, words, erode);
+  }
+  
+  // Vertical pass back into the packed frame
+  for (int y = 0; y < packedHeight; y++) {
+    const uint32_t* above = (y > 0) ? packedScratch + (y - 1) * words : NULL;
+    const uint32_t* row = packedScratch + y * words;
+    const uint32_t* below = (y < packedHeight - 1) ? packedScratch + (y + 1) * words : NULL;
+    uint32_t* out = packedFrame + y * words;
+    for (int i = 0; i < words; i++) {
+      uint32_t v = row[i];
+      if (erode) {
+        if (above) v &= above[i];
+        if (below) v &= below[i];
+      } else {
+        if (above) v |= above[i];
+        if (below) v |= below[i];
+      }
+      out[i] = v;
+    }
+  }
+  transposedStrips = 0;
+}
+
+void erodePacked() {
+  morphPacked3x3(true);
+}
+
+void dilatePacked() {
+  morphPacked3x3(false);
+}
+
+// Allocate the temporal filter ring (called once from setup)
+void initTemporalFilter() {
+  size_t frameWords = PACKED_MAX_HEIGHT * PACKED_WORDS(PACKED_MAX_WIDTH);
+  temporalRing = (uint32_t*)heap_caps_malloc(TEMPORAL_MAX_FRAMES * frameWords * sizeof(uint32_t), MALLOC_CAP_SPIRAM);
+  if (temporalRing == NULL) {
+    Serial.println("Temporal filter ring allocation failed");
+  }
+  resetTemporalFilter();
+}
+
+// Drop history (after calibration or geometry change)
+void resetTemporalFilter() {
+  temporalRingHead = 0;
+  temporalRingCount = 0;
+  temporalRingWords = 0;
+  temporalRingWidth = 0;
+}
+
+// Store packedFrame in the ring and replace it with the per-pixel majority
+// of the last temporalFilterFrames frames: maj(a,b,c) = ab | bc | ca, and
+// for 5 frames a bit-sliced count compared against 3.
+void applyTemporalFilter() {
+  if (temporalRing == NULL) return;
+  
+  int words = packedHeight * packedRowWords;
+  size_t frameStride = PACKED_MAX_HEIGHT * PACKED_WORDS(PACKED_MAX_WIDTH);
+  if (words != temporalRingWords || packedWidth != temporalRingWidth) {
+    resetTemporalFilter();
+    temporalRingWords = words;
+    temporalRingWidth = packedWidth;
+  }
+  
+  memcpy(temporalRing + temporalRingHead * frameStride, packedFrame, words * sizeof(uint32_t));
+  temporalRingHead = (temporalRingHead + 1) % TEMPORAL_MAX_FRAMES;
+  if (temporalRingCount < TEMPORAL_MAX_FRAMES) temporalRingCount++;
+  
+  // Pass frames through until enough history is collected
+  int n = (temporalFilterFrames >= 5) ? 5 : 3;
+  if (temporalRingCount < n) return;
+  
+  const uint32_t* f[5];
+  for (int k = 0; k < n; k++) {
+    int slot = (temporalRingHead - 1 - k + TEMPORAL_MAX_FRAMES) % TEMPORAL_MAX_FRAMES;
+    f[k] = temporalRing + slot * frameStride;
+  }
+  
+  if (n == 3) {
+    for (int i = 0; i < words; i++) {
+      uint32_t a = f[0][i], b = f[1][i], c = f[2][i];
+      packedFrame[i] = (a & b) | (b & c) | (c & a);
+    }
+  } else {
+    for (int i = 0; i < words; i++) {
+      uint32_t a = f[0][i], b = f[1][i], c = f[2][i], d = f[3][i], e = f[4][i];
+      // Two full adders: count = s2 + 2 * (c1 + c2), majority when count >= 3
+      uint32_t s1 = a ^ b ^ c;
+      uint32_t c1 = (a & b) | (b & c) | (c & a);
+      uint32_t s2 = s1 ^ d ^ e;
+      uint32_t c2 = (s1 & d) | (d & e) | (e & s1);
+      packedFrame[i] = (c1 & c2) | ((c1 | c2) & s2);
+    }
+  }
+  transposedStrips = 0;
+}
+
+// Clean up the binarized frame with the temporal and morphological filters.
+// Both run on the packed frame; the result is written back so all
+// byte-based analysis sees it.
+void applyBinaryFilters(uint8_t* binary_buf, size_t width, size_t height) {
+  PROFILE_REGION(PROF_FILTERS);
+  if (morphFilter == MORPH_NONE && temporalFilterFrames == 0) return;
+  if (!packBinaryFrame(binary_buf, width, height)) return;
+  
+  if (temporalFilterFrames > 0) {
+    applyTemporalFilter();
+  }
+  
+  if (morphFilter == MORPH_OPEN || morphFilter == MORPH_OPEN_CLOSE) {
+    erodePacked();
+    dilatePacked();
+  }
+  if (morphFilter == MORPH_CLOSE || morphFilter == MORPH_OPEN_CLOSE) {
+    dilatePacked();
+    erodePacked();
+  }
+  
+  unpackBinaryFrame(binary_buf);
+}
+
+// Transpose a 32x32 bit block in place (bit x of word y <-> bit y of word x)
+static void transpose32(uint32_t block[32]) {
+  uint32_t mask = 0x0000FFFF;
+  for (int j = 16; j != 0; j >>= 1, mask ^= (mask << j)) {
+    for (int k = 0; k < 32; k = ((k | j) + 1) & ~j) {
+      uint32_t t = ((block[k] >> j) ^ block[k | j]) & mask;
+      block[k] ^= t << j;
+      block[k | j] ^= t;
+    }
+  }
+}
+
+// Transpose one 32-column strip of the packed frame into packedColumns
+static void transposePackedStrip(int strip) {
+  int colWords = PACKED_WORDS(packedHeight);
+  uint32_t block[32];
+  
+  for (int by = 0; by < colWords; by++) {
+    for (int i = 0; i < 32; i++) {
+      int y = by * 32 + i;
+      block[i] = (y < packedHeight) ? packedFrame[y * packedRowWords + strip] : 0;
+    }
+    transpose32(block);
+    for (int i = 0; i < 32; i++) {
+      int x = strip * 32 + i;
+      if (x < packedWidth) {
+        packedColumns[x * colWords + by] = block[i];
+      }
+    }
+  }
+  transposedStrips |= (1u << strip);
+}
+
+// Analyze a single vertical scanline of the packed frame
+ScanlineResult analyzeColumn(int col) {
+  ScanlineResult result;
+  result.state = SCANLINE_UNDEFINED;
+  result.transitionStart = -1;
+  result.transitionEnd = -1;
+  result.blackPixelCount = 0;
+  result.runCount = 0;
+  result.lastRunStart = -1;
+  result.lastRunEnd = -1;
+  
+  if (col < 0 || col >= packedWidth) {
+    return result;
+  }
+  
+  // Strips are transposed lazily, only the ones holding analyzed columns
+  int strip = col / 32;
+  if (!(transposedStrips & (1u << strip))) {
+    transposePackedStrip(strip);
+  }
+  
+  int colWords = PACKED_WORDS(packedHeight);
+  const uint32_t* bits = packedColumns + col * colWords;
+  int firstBlackPixel = -1;
+  int lastBlackPixel = -1;
+  
+  for (int w = 0; w < colWords; w++) {
+    uint32_t word = bits[w];
+    if (word == 0) continue;
+    result.blackPixelCount += __builtin_popcount(word);
+    if (firstBlackPixel == -1) {
+      firstBlackPixel = w * 32 + __builtin_ctz(word);
+    }
+    lastBlackPixel = w * 32 + 31 - __builtin_clz(word);
+  }
+  
+  classifyScanline(result, packedHeight, firstBlackPixel, lastBlackPixel, frameLineWidth);
+  return result;
+}
+
+// Analyze a single vertical scanline of the binarized byte frame, one strided
+// byte per row; glare-masked pixels are never line, as in the packed frame
+ScanlineResult analyzeColumnBytes(const uint8_t* binary_buf, size_t width, size_t height, int col) {
+  ScanlineResult result;
+  result.state = SCANLINE_UNDEFINED;
+  result.transitionStart = -1;
+  result.transitionEnd = -1;
+  result.blackPixelCount = 0;
+  result.runCount = 0;
+  result.lastRunStart = -1;
+  result.lastRunEnd = -1;
+  
+  if (col < 0 || col >= (int)width) {
+    return result;
+  }
+  
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  int firstBlackPixel = -1;
+  int lastBlackPixel = -1;
+  for (int y = 0; y < (int)height; y++) {
+    if (binary_buf[y * width + col] != lineColor) continue;
+    const uint32_t* maskRow = glareMaskRow(width, y);
+    if (maskRow && ((maskRow[col >> 5] >> (col & 31)) & 1)) continue;
+    result.blackPixelCount++;
+    if (firstBlackPixel == -1) firstBlackPixel = y;
+    lastBlackPixel = y;
+  }
+  
+  classifyScanline(result, height, firstBlackPixel, lastBlackPixel, frameLineWidth);
+  return result;
+}
+
+// Line-colored pixels from (col, row) of the packed frame in direction step
+static int packedRowRun(int col, int row, int step) {
+  if (row < 0 || row >= packedHeight) return 0;
+  const uint32_t* bits = packedFrame + row * packedRowWords;
+  int length = 0;
+  for (int x = col; x >= 0 && x < packedWidth && ((bits[x >> 5] >> (x & 31)) & 1); x += step) {
+    length++;
+  }
+  return length;
+}
+
+// The same run in the binarized byte frame
+static int byteRowRun(const uint8_t* binary_buf, size_t width, size_t height, int col, int row, int step) {
+  if (row < 0 || row >= (int)height) return 0;
+  const uint8_t* rowPtr = binary_buf + row * width;
+  const uint32_t* maskRow = glareMaskRow(width, row);
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  int length = 0;
+  for (int x = col; x >= 0 && x < (int)width && rowPtr[x] == lineColor; x += step) {
+    if (maskRow && ((maskRow[x >> 5] >> (x & 31)) & 1)) break;
+    length++;
+  }
+  return length;
+}
+
+// Detect 90-degree corners: a line running horizontally is invisible to the
+// row scanlines, so check where it crosses vertical scanlines near the sides
+void detectCornerWithColumns(uint8_t* grayscale_buf, const ScanlineResult* rowResults, size_t width, size_t height) {
+  cornerDetected = false;
+  cornerExitSide = "none";
+  cornerExitY = -1;
+  
+  if (!columnScanEnabled) return;
+  
+  // A line that continues through the top scanline is not a corner
+  if (rowResults[0].state == SCANLINE_CROSSED) return;
+  
+  // Transposed strips of the packed frame when a binary filter already built
+  // it; packing the whole frame for two columns costs far more than reading
+  // them strided from the byte frame (/bench columnsTransposed, columnsStrided)
+  // Byte path by default: at 320x240 strided reads take ~1.1k ticks, transposed ~7k plus ~130k to pack
+  bool packed = (packedFrame != NULL && packedFrameSequence == frameSequence && packedWidth == (int)width);
+  bool deferred = binarizationDeferred(grayscale_buf);
+  
+  const int EDGE_OFFSET = 5;
+  if (deferred) {
+    binarizeDeferredColumn(grayscale_buf, width, height, EDGE_OFFSET);
+    binarizeDeferredColumn(grayscale_buf, width, height, width - EDGE_OFFSET - 1);
+  }
+  ScanlineResult left = packed ? analyzeColumn(EDGE_OFFSET) : analyzeColumnBytes(grayscale_buf, width, height, EDGE_OFFSET);
+  ScanlineResult right = packed ? analyzeColumn(width - EDGE_OFFSET - 1)
+                                : analyzeColumnBytes(grayscale_buf, width, height, width - EDGE_OFFSET - 1);
+  bool leftCrossed = (left.state == SCANLINE_CROSSED);
+  bool rightCrossed = (right.state == SCANLINE_CROSSED);
+  
+  if (!leftCrossed && !rightCrossed) return;
+  
+  cornerDetected = true;
+  if (leftCrossed && rightCrossed) {
+    // T-junction or crossing - both sides are open, keep row-based direction
+    cornerExitSide = "both";
+    cornerExitY = (left.transitionStart + left.transitionEnd + right.transitionStart + right.transitionEnd) / 4;
+    return;
+  }
+  
+  const ScanlineResult& exitResult = leftCrossed ? left : right;
+  int exitY = (exitResult.transitionStart + exitResult.transitionEnd) / 2;
+  
+  // A diagonal curve also crosses the side column; only a near-horizontal
+  // line reaches that far inward along the row of the crossing
+  int exitCol = leftCrossed ? EDGE_OFFSET : width - EDGE_OFFSET - 1;
+  int step = leftCrossed ? 1 : -1;
+  if (deferred && exitY >= 0 && exitY < (int)height) binarizeDeferredRow(grayscale_buf, width, exitY);
+  int inward = packed ? packedRowRun(exitCol, exitY, step) : byteRowRun(grayscale_buf, width, height, exitCol, exitY, step);
+  if (inward < CORNER_MIN_INWARD_RUN * frameLineWidth) {
+    cornerDetected = false;
+    return;
+  }
+  cornerExitSide = leftCrossed ? "left" : "right";
+  cornerExitY = exitY;
+  
+  // Corner overrides the row-based curve estimate
+  turnDirection = cornerExitSide;
+  curveAngle = leftCrossed ? -90.0 : 90.0;
+  sharpTurnDetected = true;
+}
+
+// Find the line run nearest to predictedX within the tracer window.
+// Returns the run center or -1; edgeHit is set if the run is clipped by the frame border.
+static int traceFindRun(const uint8_t* rowPtr, int width, int predictedX, uint8_t lineColor, int expectedWidth, bool& edgeHit) {
+  int expectedMin = expectedWidth - frameLineTolerance;
+  int expectedMax = expectedWidth + frameLineTolerance;
+  int lo = predictedX - TRACE_WINDOW;
+  int hi = predictedX + TRACE_WINDOW;
+  if (lo < 0) lo = 0;
+  if (hi > width - 1) hi = width - 1;
+  
+  // Back up to the start of a run that crosses the left window edge
+  int x = lo;
+  while (x > 0 && rowPtr[x - 1] == lineColor && lo - x < expectedMax) {
+    x--;
+  }
+  
+  int bestCenter = -1;
+  int bestDist = width;
+  edgeHit = false;
+  
+  while (x <= hi) {
+    if (rowPtr[x] != lineColor) {
+      x++;
+      continue;
+    }
+    int start = x;
+    while (x < width && rowPtr[x] == lineColor) {
+      x++;
+    }
+    int runWidth = x - start;
+    bool clipped = (start == 0 || x == width);
+    
+    // Runs cut by the frame border only need half the expected width
+    if ((runWidth >= expectedMin || (clipped && runWidth >= expectedMin / 2)) && runWidth <= expectedMax) {
+      int center = (start + x - 1) / 2;
+      int dist = abs(center - predictedX);
+      if (dist < bestDist) {
+        bestDist = dist;
+        bestCenter = center;
+        edgeHit = clipped;
+      }
+    }
+  }
+  return bestCenter;
+}
+
+// Trace the line upward row by row, following curves, until it leaves the frame.
+// Work is proportional to line length times window width, not frame area.
+void traceLineFromBottom(uint8_t* grayscale_buf, size_t width, size_t height, int seedX, int seedRow) {
+  PROFILE_REGION(PROF_TRACER);
+  traceLength = 0;
+  traceTurnAngle = 0.0;
+  traceCurvature = 0.0;
+  
+  if (seedX < 0 || seedRow < 0 || seedRow >= (int)height) return;
+  bool deferred = binarizationDeferred(grayscale_buf);
+  
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  
+  // Keep the row step large enough that the whole frame fits in the buffer
+  int rowStep = (height + TRACE_MAX_POINTS - 1) / TRACE_MAX_POINTS;
+  if (rowStep < 2) rowStep = 2;
+  
+  int predictedX = seedX;
+  int slope = 0; // Horizontal shift per row step from the last two points
+  int misses = 0;
+  
+  for (int y = seedRow; y >= 0 && traceLength < TRACE_MAX_POINTS; y -= rowStep) {
+    bool edgeHit = false;
+    if (deferred) binarizeDeferredRow(grayscale_buf, width, y);
+    int center = traceFindRun(grayscale_buf + y * width, width, predictedX, lineColor, expectedLineWidthForRow(y), edgeHit);
+    
+    if (center < 0) {
+      if (++misses > TRACE_MAX_MISSES) break;
+      predictedX += slope;
+      if (predictedX < 0 || predictedX >= (int)width) break;
+      continue;
+    }
+    
+    if (traceLength > 0) {
+      const TracePoint& prev = tracePoints[traceLength - 1];
+      int steps = (prev.y - y) / rowStep;
+      slope = (center - prev.x) / (steps > 0 ? steps : 1);
+    }
+    misses = 0;
+    tracePoints[traceLength].x = center;
+    tracePoints[traceLength].y = y;
+    traceLength++;
+    
+    // Line leaves the frame through a side edge
+    if (edgeHit) break;
+    
+    predictedX = center + slope;
+  }
+  
+  if (traceLength < 3) return;
+  
+  // Heading (0 = straight ahead) of the first and second halves of the polyline
+  const TracePoint& first = tracePoints[0];
+  const TracePoint& mid = tracePoints[traceLength / 2];
+  const TracePoint& last = tracePoints[traceLength - 1];
+  float headingStart = atan2(mid.x - first.x, first.y - mid.y);
+  float headingEnd = atan2(last.x - mid.x, mid.y - last.y);
+  traceTurnAngle = (headingEnd - headingStart) * 180.0 / 3.14159;
+  
+  // Curvature = heading change over arc length of the polyline
+  float arcLength = 0.0;
+  for (int i = 1; i < traceLength; i++) {
+    float dx = tracePoints[i].x - tracePoints[i - 1].x;
+    float dy = tracePoints[i].y - tracePoints[i - 1].y;
+    arcLength += sqrt(dx * dx + dy * dy);
+  }
+  if (arcLength > 0) {
+    traceCurvature = (headingEnd - headingStart) / arcLength;
+  }
+}
+
+// New line detection using 4 scanning lines approach
+void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t height) {
+  PROFILE_REGION(PROF_DETECT);
+  
+  // Row scanners follow the current line color and glare settings
+  selectDetectorPipeline();
+  
+  // Scale line width constants to the current frame width
+  frameLineWidth = EXPECTED_LINE_WIDTH * width / LINE_WIDTH_REFERENCE;
+  frameLineTolerance = LINE_WIDTH_THRESHOLD * width / LINE_WIDTH_REFERENCE;
+  if (learnedForFrameWidth != (int)width) {
+    // Learned widths only apply to the frame size they were measured at
+    resetLearnedLineWidths();
+    learnedForFrameWidth = width;
+  }
+  
+  // Reset detection values
+  laneBoundaryMissing = false;
+  lineCenterX = -1;
+  lineCenterTop = -1;
+  lineCenterMiddle = -1;
+  lineCenterBottom = -1;
+  lineBridged = false;
+  regionBridged[0] = regionBridged[1] = regionBridged[2] = false;
+  nearFieldCount = 0;
+  
+  if (!detectorFrameSupported(width, height)) {
+    memset(scanlineStates, SCANLINE_UNDEFINED, sizeof(scanlineStates));
+    traceLength = 0;
+    pathWaypointCount = 0;
+    detectCurveAndTurn(width);
+    return;
+  }
+  
+  // 4 initial scanning lines (top, upper-middle, lower-middle, bottom) from
+  // the scanline plan for the current speed and curvature
+  const ScanlinePlan* plan = planScanlines(width, height);
+  const int16_t* scanlines = plan->rows;
   
   // Analyze all 4 initial scanlines
   ScanlineResult results[4];
   for (int i = 0; i < 4; i++) {
-    results[i] = analyzeScanline(grayscale_buf, width, scanlines[i]);
+    results[i] = analyzeScanline(grayscale_buf, width, height, scanlines[i]);
+    scanlineLineWidths[i] = expectedLineWidthForRow(scanlines[i]);
     
+    if (!detectorLogEnabled) continue;
     Serial.printf("Scanline %d (row %d): ", i, scanlines[i]);
     switch (results[i].state) {
       case SCANLINE_WHITE:
@@ -387,6 +2607,11 @@ void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t
     }
   }
   
+  // Nominal rows of the regions, replaced by the row each center is found on
+  lineRegionRows[0] = scanlines[0];
+  lineRegionRows[1] = (scanlines[1] + scanlines[2]) / 2;
+  lineRegionRows[2] = scanlines[3];
+  
   // Binary search approach to find line position
   // Strategy: Find the region where the line is located by analyzing scanline states
   
@@ -398,10 +2623,13 @@ void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t
       // Assign to appropriate region based on scanline position
       if (i == 0) {
         lineCenterTop = center;
+        lineRegionRows[0] = scanlines[i];
       } else if (i == 1 || i == 2) {
         lineCenterMiddle = center;
+        lineRegionRows[1] = scanlines[i];
       } else {
         lineCenterBottom = center;
+        lineRegionRows[2] = scanlines[i];
       }
     }
   }
@@ -425,10 +2653,11 @@ void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t
     int searchRow = (searchStart + searchEnd) / 2;
     
     // Scan this row to find line edges
-    ScanlineResult binaryResult = analyzeScanline(grayscale_buf, width, searchRow);
+    ScanlineResult binaryResult = analyzeScanline(grayscale_buf, width, height, searchRow);
     if (binaryResult.state == SCANLINE_CROSSED) {
       int center = (binaryResult.transitionStart + binaryResult.transitionEnd) / 2;
       lineCenterMiddle = center;
+      lineRegionRows[1] = searchRow;
     }
   }
   
@@ -440,21 +2669,49 @@ void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t
       // Use the CROSSED scanline result
       int center = (results[i+1].transitionStart + results[i+1].transitionEnd) / 2;
       if (i == 0 || i == 1) {
-        if (lineCenterTop == -1) lineCenterTop = center;
+        if (lineCenterTop == -1) {
+          lineCenterTop = center;
+          lineRegionRows[0] = scanlines[i+1];
+        }
       } else {
-        if (lineCenterMiddle == -1) lineCenterMiddle = center;
+        if (lineCenterMiddle == -1) {
+          lineCenterMiddle = center;
+          lineRegionRows[1] = scanlines[i+1];
+        }
       }
     } else if (results[i].state == SCANLINE_CROSSED && results[i+1].state == SCANLINE_WHITE) {
       // Line ends between these two scanlines
       int center = (results[i].transitionStart + results[i].transitionEnd) / 2;
       if (i < 2) {
-        if (lineCenterMiddle == -1) lineCenterMiddle = center;
+        if (lineCenterMiddle == -1) {
+          lineCenterMiddle = center;
+          lineRegionRows[1] = scanlines[i];
+        }
       } else {
-        if (lineCenterBottom == -1) lineCenterBottom = center;
+        if (lineCenterBottom == -1) {
+          lineCenterBottom = center;
+          lineRegionRows[2] = scanlines[i];
+        }
       }
     }
   }
   
+  // Near-field rows of the plan (turns), nearest first: every crossing is a
+  // point for the curve estimate and the path, and the lowest one stands in
+  // for a bottom scanline that lost the line
+  for (int i = plan->count - 1; i >= 4; i--) {
+    ScanlineResult nearResult = analyzeScanline(grayscale_buf, width, height, scanlines[i]);
+    if (nearResult.state != SCANLINE_CROSSED) continue;
+    int center = (nearResult.transitionStart + nearResult.transitionEnd) / 2;
+    nearFieldPoints[nearFieldCount].x = center;
+    nearFieldPoints[nearFieldCount].y = scanlines[i];
+    nearFieldCount++;
+    if (lineCenterBottom == -1) {
+      lineCenterBottom = center;
+      lineRegionRows[2] = scanlines[i];
+    }
+  }
+  
   // Additional binary search iterations if needed
   // If we haven't found the line yet, try intermediate scanlines
   if (lineCenterBottom == -1 && lineCenterMiddle == -1 && lineCenterTop == -1) {
@@ -463,16 +2720,19 @@ void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t
       // Search between pairs of scanlines
       for (int i = 0; i < 3; i++) {
         int midRow = (scanlines[i] + scanlines[i+1]) / 2;
-        ScanlineResult midResult = analyzeScanline(grayscale_buf, width, midRow);
+        ScanlineResult midResult = analyzeScanline(grayscale_buf, width, height, midRow);
         
         if (midResult.state == SCANLINE_CROSSED) {
           int center = (midResult.transitionStart + midResult.transitionEnd) / 2;
           if (i == 0) {
             lineCenterTop = center;
+            lineRegionRows[0] = midRow;
           } else if (i == 1) {
             lineCenterMiddle = center;
+            lineRegionRows[1] = midRow;
           } else {
             lineCenterBottom = center;
+            lineRegionRows[2] = midRow;
           }
           break; // Found line, stop searching
         }
@@ -485,6 +2745,9 @@ void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t
     }
   }
   
+  // Fill regions that fell into gaps of a dashed line
+  bridgeLineGaps(lineRegionRows, width);
+  
   // Set primary detection (prefer bottom, then middle, then top)
   if (lineCenterBottom >= 0) {
     lineCenterX = lineCenterBottom;
@@ -494,10 +2757,54 @@ void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t
     lineCenterX = lineCenterTop;
   }
   
+  if (laneModeEnabled) {
+    // The lane table is per row of a frame up to MAX_FRAME_ROWS tall
+    int bottomRow = scanlines[3];
+    laneWidthBottom = (bottomRow >= 0 && bottomRow < MAX_FRAME_ROWS) ? laneWidthByRow[bottomRow] : 0;
+  }
+  
+  // Follow the line upward from the detection nearest to the robot
+  // (the tracer and corner check follow a single line, not a lane)
+  // Seed on the row the center was actually measured on; a bridged center
+  // is only a fit and would start the walk off the line
+  if (lineTracerEnabled && !laneModeEnabled) {
+    int regionCenters[3] = {lineCenterTop, lineCenterMiddle, lineCenterBottom};
+    int seedX = -1, seedRow = -1;
+    for (int r = 2; r >= 0; r--) {
+      if (regionCenters[r] >= 0 && !regionBridged[r]) {
+        seedX = regionCenters[r];
+        seedRow = lineRegionRows[r];
+        break;
+      }
+    }
+    traceLineFromBottom(grayscale_buf, width, height, seedX, seedRow);
+  } else {
+    traceLength = 0;
+  }
+  
   // Detect curves and turns based on multi-region data
-  detectCurveAndTurn(width);
+  activeDetectorPipeline->estimateCurve(width);
+  
+  // Check side columns for 90-degree corners the rows cannot see
+  if (!laneModeEnabled) {
+    detectCornerWithColumns(grayscale_buf, results, width, height);
+  } else {
+    cornerDetected = false;
+    cornerExitSide = "none";
+    cornerExitY = -1;
+  }
   
-  // Debug output
+  computeDetectionConfidence(results, width);
+  buildPathWaypoints(width, height);
+  
+  // Debug output (at 115200 baud these lines cost more than the detection)
+  if (!detectorLogEnabled) return;
+  if (traceLength > 0) {
+    Serial.printf("Trace: %d points, turn=%.1f°, curvature=%.4f\n", traceLength, traceTurnAngle, traceCurvature);
+  }
+  if (cornerDetected) {
+    Serial.printf("Corner detected: exit=%s at row %d\n", cornerExitSide.c_str(), cornerExitY);
+  }
   if (lineCenterX >= 0) {
     Serial.printf("Line detected: center=%d (T:%d M:%d B:%d), angle=%.1f°, turn=%s\n", 
                   lineCenterX, lineCenterTop, lineCenterMiddle, lineCenterBottom,
@@ -507,13 +2814,736 @@ void detectLineCenterWithScanlines(uint8_t* grayscale_buf, size_t width, size_t
   }
 }
 
+// Precompute scanline plans for a frame size. Speed moves the top row from a
+// quarter of the frame (slow, look near) up to the edge (fast, look far);
+// the middle rows split the span evenly. Curvature adds 0, 2 or 4 near-field
+// rows between the lower-middle and bottom rows, capped by the pixel budget.
+void buildScanlinePlans(size_t width, size_t height) {
+  const int EDGE_OFFSET = 5;
+  // Frames shorter than the edge margins get rows pinned inside the frame
+  int lastRow = (height > 0) ? (int)height - 1 : 0;
+  int bottom = constrain((int)height - EDGE_OFFSET - 1, 0, lastRow);
+  
+  fixedScanlinePlan.count = 4;
+  fixedScanlinePlan.rows[0] = (EDGE_OFFSET < bottom) ? EDGE_OFFSET : bottom;
+  fixedScanlinePlan.rows[1] = height / 3;
+  fixedScanlinePlan.rows[2] = (2 * height) / 3;
+  fixedScanlinePlan.rows[3] = bottom;
+  
+  int budgetRows = (width > 0) ? SCANLINE_PIXEL_BUDGET / width : PLAN_MAX_ROWS;
+  if (budgetRows > PLAN_MAX_ROWS) budgetRows = PLAN_MAX_ROWS;
+  
+  for (int s = 0; s < PLAN_SPEED_LEVELS; s++) {
+    int top = EDGE_OFFSET + (height / 4) * (PLAN_SPEED_LEVELS - 1 - s) / (PLAN_SPEED_LEVELS - 1);
+    if (top > bottom) top = bottom;
+    for (int c = 0; c < PLAN_CURVE_LEVELS; c++) {
+      ScanlinePlan& plan = scanlinePlans[s][c];
+      plan.rows[0] = top;
+      plan.rows[1] = top + (bottom - top) / 3;
+      plan.rows[2] = top + (2 * (bottom - top)) / 3;
+      plan.rows[3] = bottom;
+      
+      int extra = 2 * c;
+      if (4 + extra > budgetRows) extra = (budgetRows > 4) ? budgetRows - 4 : 0;
+      for (int e = 0; e < extra; e++) {
+        plan.rows[4 + e] = plan.rows[2] + (bottom - plan.rows[2]) * (e + 1) / (extra + 1);
+      }
+      plan.count = 4 + extra;
+    }
+  }
+  
+  scanlinePlanWidth = width;
+  scanlinePlanHeight = height;
+}
+
+// Select this frame's scanline plan from the commanded speed and the curve
+// measured in the previous frame
+const ScanlinePlan* planScanlines(size_t width, size_t height) {
+  if (scanlinePlanWidth != (int)width || scanlinePlanHeight != (int)height) {
+    buildScanlinePlans(width, height);
+  }
+  
+  if (!adaptiveScanlinesEnabled) {
+    activeScanlinePlan = &fixedScanlinePlan;
+  } else {
+    int speedLevel = constrain(commandedSpeed, 0, 100) * PLAN_SPEED_LEVELS / 101;
+    float angle = fabs(curveAngle);
+    int curveLevel = sharpTurnDetected ? 2 : (angle > 10.0 ? 1 : 0);
+    activeScanlinePlan = &scanlinePlans[speedLevel][curveLevel];
+  }
+  return activeScanlinePlan;
+}
+
+// Project an image point onto the floor with the flat-floor pinhole model
+static void projectToGround(PathWaypoint& wp, size_t width, size_t height) {
+  float focal = (width / 2.0) / tan(cameraHfovDeg * 3.14159 / 360.0);
+  float u = (wp.x - width / 2.0) / focal;
+  float v = (height / 2.0 - wp.y) / focal;
+  float pitch = cameraPitchDeg * 3.14159 / 180.0;
+  float forward = cos(pitch) + v * sin(pitch);
+  float up = v * cos(pitch) - sin(pitch);
+  if (up >= -0.001) {
+    wp.groundX = 0.0;
+    wp.groundY = -1.0; // Ray never reaches the floor
+    return;
+  }
+  float t = cameraHeightMm / -up;
+  wp.groundX = t * u;
+  wp.groundY = t * forward;
+}
+
+// Resample the detected line into PATH_WAYPOINTS evenly spaced rows from the
+// nearest to the farthest known point. Uses only points found this frame.
+void buildPathWaypoints(size_t width, size_t height) {
+  TracePoint* source = arenaAllocArray<TracePoint>(TRACE_MAX_POINTS);
+  int sourceCount = 0;
+  if (source == NULL) {
+    pathWaypointCount = 0;
+    return;
+  }
+  
+  if (traceLength >= 2) {
+    for (int i = 0; i < traceLength; i++) {
+      source[sourceCount++] = tracePoints[i];
+    }
+  } else {
+    // Region centers with the near-field crossings between bottom and middle
+    TracePoint candidates[3 + NEAR_FIELD_MAX_POINTS];
+    int candidateCount = 0;
+    if (lineCenterBottom >= 0) candidates[candidateCount++] = {(int16_t)lineCenterBottom, (int16_t)lineRegionRows[2]};
+    for (int i = 0; i < nearFieldCount; i++) candidates[candidateCount++] = nearFieldPoints[i];
+    if (lineCenterMiddle >= 0) candidates[candidateCount++] = {(int16_t)lineCenterMiddle, (int16_t)lineRegionRows[1]};
+    if (lineCenterTop >= 0) candidates[candidateCount++] = {(int16_t)lineCenterTop, (int16_t)lineRegionRows[0]};
+    for (int c = 0; c < candidateCount; c++) {
+      // Keep the points ordered upward
+      if (sourceCount > 0 && candidates[c].y >= source[sourceCount - 1].y) continue;
+      source[sourceCount++] = candidates[c];
+    }
+  }
+  
+  if (sourceCount == 0) {
+    pathWaypointCount = 0;
+    return;
+  }
+  
+  if (sourceCount == 1) {
+    pathWaypoints[0].x = source[0].x;
+    pathWaypoints[0].y = source[0].y;
+    pathWaypoints[0].heading = 0.0;
+    pathWaypointCount = 1;
+  } else {
+    float nearY = source[0].y;
+    float farY = source[sourceCount - 1].y;
+    int seg = 0;
+    for (int k = 0; k < PATH_WAYPOINTS; k++) {
+      float y = nearY + (farY - nearY) * k / (PATH_WAYPOINTS - 1);
+      // Segment [seg, seg + 1] containing y (points go upward, y decreasing)
+      while (seg < sourceCount - 2 && source[seg + 1].y > y) seg++;
+      float dx = source[seg + 1].x - source[seg].x;
+      float dy = source[seg + 1].y - source[seg].y;
+      float t = (dy != 0) ? (y - source[seg].y) / dy : 0.0;
+      pathWaypoints[k].x = source[seg].x + t * dx;
+      pathWaypoints[k].y = y;
+    }
+    
+    // Heading from neighbouring waypoints, with their actual dx and dy:
+    // tracer points are rowStep (at least 2) rows apart, more across misses,
+    // with whole-pixel x, so one segment's direction moves in steps of
+    // atan(1 / rowStep) and the difference over two waypoints is smoother
+    for (int k = 0; k < PATH_WAYPOINTS; k++) {
+      const PathWaypoint& a = pathWaypoints[(k > 0) ? k - 1 : k];
+      const PathWaypoint& b = pathWaypoints[(k < PATH_WAYPOINTS - 1) ? k + 1 : k];
+      pathWaypoints[k].heading = atan2(b.x - a.x, a.y - b.y) * 180.0 / 3.14159;
+    }
+    pathWaypointCount = PATH_WAYPOINTS;
+  }
+  
+  for (int k = 0; k < pathWaypointCount; k++) {
+    if (cameraHeightMm > 0) {
+      projectToGround(pathWaypoints[k], width, height);
+    } else {
+      pathWaypoints[k].groundX = 0.0;
+      pathWaypoints[k].groundY = -1.0;
+    }
+  }
+}
+
+// Waypoints as a JSON array of {x, y, heading[, gx, gy]} objects
+String pathToJson() {
+  String json = "[";
+  for (int k = 0; k < pathWaypointCount; k++) {
+    if (k > 0) json += ",";
+    json += "{\"x\":" + String(pathWaypoints[k].x, 1) + ",\"y\":" + String(pathWaypoints[k].y, 1);
+    json += ",\"heading\":" + String(pathWaypoints[k].heading, 1);
+    if (cameraHeightMm > 0) {
+      json += ",\"gx\":" + String((int)pathWaypoints[k].groundX) + ",\"gy\":" + String((int)pathWaypoints[k].groundY);
+    }
+    json += "}";
+  }
+  json += "]";
+  return json;
+}
+
+// Measure line/field contrast on the 4 scanlines before binarization: mean of
+// pixels above the threshold minus mean of pixels below it
+void measureScanlineContrast(const uint8_t* grayscale_buf, size_t width, size_t height) {
+  if (!detectorFrameSupported(width, height)) return;
+  const int16_t* scanlines = planScanlines(width, height)->rows;
+  
+  for (int i = 0; i < 4; i++) {
+    if (scanlines[i] < 0 || scanlines[i] >= (int)height) {
+      scanlineContrast[i] = 0;
+      continue;
+    }
+    const uint8_t* rowPtr = grayscale_buf + scanlines[i] * width;
+    int darkSum = 0, darkCount = 0;
+    int brightSum = 0, brightCount = 0;
+    for (int x = 0; x < (int)width; x++) {
+      if (rowPtr[x] < binaryThreshold) {
+        darkSum += rowPtr[x];
+        darkCount++;
+      } else {
+        brightSum += rowPtr[x];
+        brightCount++;
+      }
+    }
+    if (darkCount > 0 && brightCount > 0) {
+      scanlineContrast[i] = brightSum / brightCount - darkSum / darkCount;
+    } else {
+      scanlineContrast[i] = 0;
+    }
+  }
+}
+
+// Flag frame sides where most border samples differ from the field level by
+// more than boundaryDelta (floor edge, table, tape outside the field). The
+// field level follows field-colored samples of unflagged sides.
+void monitorFieldBoundary(const uint8_t* grayscale_buf, size_t width, size_t height) {
+  if (!detectorFrameSupported(width, height)) return;
+  // First pixel and pixel stride of each side: top, bottom, left, right
+  const uint8_t* sideStart[4] = {
+    grayscale_buf,
+    grayscale_buf + (height - 1) * width,
+    grayscale_buf,
+    grayscale_buf + width - 1
+  };
+  const int sideStride[4] = {1, 1, (int)width, (int)width};
+  const int sideLength[4] = {(int)width, (int)width, (int)height, (int)height};
+  
+  uint8_t sides = 0;
+  int fieldSum = 0;
+  int fieldCount = 0;
+  
+  for (int s = 0; s < 4; s++) {
+    int spacing = sideLength[s] / BOUNDARY_SAMPLES;
+    const uint8_t* p = sideStart[s] + (spacing / 2) * sideStride[s];
+    int offField = 0;
+    int sideFieldSum = 0;
+    int sideFieldCount = 0;
+    
+    for (int i = 0; i < BOUNDARY_SAMPLES; i++) {
+      int v = p[i * spacing * sideStride[s]];
+      if (fieldLevel >= 0 && abs(v - fieldLevel) > boundaryDelta) {
+        offField++;
+      } else if (invertColors ? (v < binaryThreshold) : (v >= binaryThreshold)) {
+        sideFieldSum += v;
+        sideFieldCount++;
+      }
+    }
+    
+    boundaryOffField[s] = offField * 100 / BOUNDARY_SAMPLES;
+    bool wasFlagged = boundarySides & (1 << s);
+    if (boundaryOffField[s] >= (wasFlagged ? BOUNDARY_EXIT_PERCENT : BOUNDARY_ENTER_PERCENT)) {
+      sides |= 1 << s;
+    } else {
+      fieldSum += sideFieldSum;
+      fieldCount += sideFieldCount;
+    }
+  }
+  
+  if (sides & ~boundarySides) {
+    boundaryEventCount++;
+    boundaryEventFrame = frameSequence;
+    Serial.printf("Field boundary: sides 0x%X (off-field T:%d%% B:%d%% L:%d%% R:%d%%)\n", sides,
+                  boundaryOffField[0], boundaryOffField[1], boundaryOffField[2], boundaryOffField[3]);
+  }
+  boundarySides = sides;
+  
+  if (fieldCount > 0) {
+    int mean = fieldSum / fieldCount;
+    fieldLevel = (fieldLevel < 0) ? mean : (fieldLevel * 7 + mean) / 8;
+  }
+}
+
+// Count sensor frames skipped by the driver between this frame and the last
+static inline int64_t frameTimestampUs(const camera_fb_t* fb) {
+  return (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+// Sensor period from the low end of the gaps: dropped frames only make gaps
+// longer, so under steady backpressure every gap is a multiple of the period
+// and a median would settle on the multiple. The second shortest gap since
+// the camera settings changed (the frame rate only changes with them) ignores
+// one short outlier from timestamp jitter. The configured rate, when set, caps
+// it, so drops are counted even when no frame arrived a period apart.
+static void updateSensorFramePeriod(uint32_t gap) {
+  if (frameGapCount == 0 || gap < shortestFrameGapsUs[0]) {
+    shortestFrameGapsUs[1] = (frameGapCount == 0) ? gap : shortestFrameGapsUs[0];
+    shortestFrameGapsUs[0] = gap;
+  } else if (gap < shortestFrameGapsUs[1]) {
+    shortestFrameGapsUs[1] = gap;
+  }
+  if (frameGapCount < 2) frameGapCount++;
+  
+  sensorFramePeriodUs = shortestFrameGapsUs[1];
+  if (sensorFrameRate > 0) {
+    uint32_t configuredUs = 1000000 / sensorFrameRate;
+    if (configuredUs < sensorFramePeriodUs) sensorFramePeriodUs = configuredUs;
+  }
+}
+
+void accountFetchedFrame(const camera_fb_t* fb) {
+  int64_t ts = frameTimestampUs(fb);
+  frameStats.fetched++;
+  
+  // A repeated sensor frame adds nothing here; it is counted stale when served
+  if (lastFrameTimestampUs < 0) {
+    frameStats.captured++;
+  } else if (ts > lastFrameTimestampUs) {
+    uint32_t gap = ts - lastFrameTimestampUs;
+    updateSensorFramePeriod(gap);
+    uint32_t periods = (gap + sensorFramePeriodUs / 2) / sensorFramePeriodUs;
+    frameStats.captured += periods;
+    frameStats.droppedGrab += periods - 1;
+  }
+  lastFrameTimestampUs = ts;
+}
+
+// Frame age and output rate when the result leaves the device
+void accountServedFrame(const camera_fb_t* fb) {
+  int64_t now = esp_timer_get_time();
+  if (lastServedUs >= 0) {
+    uint32_t interval = now - lastServedUs;
+    servedIntervalUs = (servedIntervalUs == 0) ? interval : (servedIntervalUs * 7 + interval) / 8;
+  }
+  lastServedUs = now;
+  
+  // Stale: the same sensor frame as last time, or too old
+  int64_t ts = frameTimestampUs(fb);
+  lastFrameAgeUs = now - ts;
+  bool repeated = (ts == lastServedTimestampUs);
+  if (repeated || (sensorFramePeriodUs > 0 && lastFrameAgeUs > FRAME_STALE_PERIODS * sensorFramePeriodUs)) {
+    frameStats.staleServed++;
+  }
+  lastServedTimestampUs = ts;
+}
+
+uint32_t droppedFrameCount() {
+  return frameStats.droppedGrab + frameStats.droppedCapture + frameStats.droppedFormat + frameStats.droppedEncode;
+}
+
+void resetFrameStats() {
+  memset(&frameStats, 0, sizeof(frameStats));
+  lastFrameTimestampUs = -1;
+  sensorFramePeriodUs = 0;
+  frameGapCount = 0;
+  servedIntervalUs = 0;
+  lastServedUs = -1;
+  lastServedTimestampUs = -1;
+}
+
+// Add one scheduler sample to the task table: CPU share of each task over
+// the interval since the previous sample (all cores together = 1000 permille).
+// Counters are unsigned so wraparound between samples is harmless.
+void recordTaskSamples(const TaskSample* samples, int count, uint32_t totalRunTime, int cores) {
+  uint32_t elapsed = totalRunTime - taskLastTotalRunTime;
+  taskLastTotalRunTime = totalRunTime;
+  
+  for (int t = 0; t < TASK_MAX_TRACKED; t++) {
+    taskSlots[t].alive = false;
+  }
+  
+  for (int i = 0; i < count; i++) {
+    const TaskSample& sample = samples[i];
+    
+    // Find the task's slot (task numbers are unique for the task's lifetime)
+    int slot = -1;
+    int freeSlot = -1;
+    for (int t = 0; t < TASK_MAX_TRACKED; t++) {
+      if (taskSlots[t].used && taskSlots[t].last.id == sample.id) {
+        slot = t;
+        break;
+      }
+      if (freeSlot < 0 && !taskSlots[t].used) freeSlot = t;
+    }
+    
+    bool isNew = false;
+    if (slot < 0) {
+      if (freeSlot < 0) {
+        taskTableOverflows++;
+        continue;
+      }
+      slot = freeSlot;
+      memset(&taskSlots[slot], 0, sizeof(TaskSlot));
+      taskSlots[slot].used = true;
+      isNew = true;
+    }
+    
+    TaskSlot& entry = taskSlots[slot];
+    uint32_t runDelta = sample.runTime - entry.last.runTime;
+    entry.last = sample;
+    entry.alive = true;
+    
+    // A new task has no previous counter to compare with
+    uint32_t permille = 0;
+    if (!isNew && elapsed > 0 && cores > 0) {
+      permille = (uint32_t)((uint64_t)runDelta * 1000 / ((uint64_t)elapsed * cores));
+      if (permille > 1000) permille = 1000;
+    }
+    entry.cpuPermille[taskRingHead] = permille;
+  }
+  
+  // Tasks that disappeared free their slots
+  for (int t = 0; t < TASK_MAX_TRACKED; t++) {
+    if (taskSlots[t].used && !taskSlots[t].alive) {
+      taskSlots[t].used = false;
+    }
+  }
+  
+  taskRingHead = (taskRingHead + 1) % TASK_RING_SAMPLES;
+  if (taskRingCount < TASK_RING_SAMPLES) taskRingCount++;
+}
+
+// printf-style append for the JSON formatters: len keeps counting past
+// size, so the caller sees a truncated document as len >= size
+void jsonAppend(char* out, size_t size, size_t& len, const char* format, ...) {
+  if (len >= size) return;
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(out + len, size - len, format, args);
+  va_end(args);
+  if (n > 0) len += n;
+}
+
+// Task table as JSON: latest stack/priority/core per task, CPU % of the last
+// interval, peak over the history and the history itself (oldest first)
+size_t formatTaskStatsJson(char* out, size_t size, int cores) {
+  size_t len = 0;
+  jsonAppend(out, size, len, "{\"cpuStats\":%s,\"cores\":%d,\"periodMs\":%d,\"samples\":%d,\"overflows\":%lu,\"tasks\":[",
+             taskCpuStatsAvailable ? "true" : "false", cores, TASK_SAMPLE_PERIOD_MS, taskRingCount,
+             (unsigned long)taskTableOverflows);
+  bool first = true;
+  int latest = (taskRingHead + TASK_RING_SAMPLES - 1) % TASK_RING_SAMPLES;
+  for (int t = 0; t < TASK_MAX_TRACKED; t++) {
+    const TaskSlot& entry = taskSlots[t];
+    if (!entry.used) continue;
+    
+    uint16_t peak = 0;
+    for (int k = 0; k < taskRingCount; k++) {
+      if (entry.cpuPermille[k] > peak) peak = entry.cpuPermille[k];
+    }
+    jsonAppend(out, size, len, "%s{\"name\":\"%.15s\",\"core\":%d,\"priority\":%u,\"stackFree\":%lu,\"cpu\":%u.%u,\"peakCpu\":%u.%u,\"history\":[",
+               first ? "" : ",", entry.last.name, entry.last.core, entry.last.priority,
+               (unsigned long)entry.last.stackHighWater, entry.cpuPermille[latest] / 10, entry.cpuPermille[latest] % 10,
+               peak / 10, peak % 10);
+    for (int k = 0; k < taskRingCount; k++) {
+      int idx = (taskRingHead + TASK_RING_SAMPLES - taskRingCount + k) % TASK_RING_SAMPLES;
+      jsonAppend(out, size, len, "%s%u", k ? "," : "", entry.cpuPermille[idx]);
+    }
+    jsonAppend(out, size, len, "]}");
+    first = false;
+  }
+  jsonAppend(out, size, len, "]}");
+  
+  if (len >= size) {
+    // Truncated output is not valid JSON
+    snprintf(out, size, "{\"error\":\"task table too large\"}");
+    len = strlen(out);
+  }
+  return len;
+}
+
+// Sample free size, largest block and low-water mark of internal RAM and
+// PSRAM; a shrinking largest block with steady free size means fragmentation
+void sampleHeapStats() {
+  HeapSample sample;
+  sample.uptimeS = millis() / 1000;
+  sample.internal.freeBytes = heap_caps_get_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  sample.internal.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  sample.internal.minimumFree = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  sample.psram.freeBytes = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+  sample.psram.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+  sample.psram.minimumFree = heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM);
+  
+  heapLatest = sample;
+  heapRing[heapRingHead] = sample;
+  heapRingHead = (heapRingHead + 1) % HEAP_RING_SAMPLES;
+  if (heapRingCount < HEAP_RING_SAMPLES) heapRingCount++;
+  
+  uint32_t warnBytes = heapWarnInternalKb * 1024;
+  bool warning = sample.internal.freeBytes < warnBytes || sample.internal.largestBlock < warnBytes;
+  if (warning && !heapWarning) {
+    heapWarningCount++;
+    Serial.printf("WARNING: low internal heap: free=%lu largest=%lu min=%lu\n", (unsigned long)sample.internal.freeBytes,
+                  (unsigned long)sample.internal.largestBlock, (unsigned long)sample.internal.minimumFree);
+    if (!heapEventPending) {
+      heapEventFree = sample.internal.freeBytes;
+      heapEventLargest = sample.internal.largestBlock;
+      heapEventMs = millis();
+      heapEventPending = true;
+    }
+  }
+  heapWarning = warning;
+}
+
+// Send a heap warning queued by loop(); called from async_tcp handlers only
+void publishHeapEvent() {
+  if (!heapEventPending) return;
+  if (events.count() > 0) {
+    String heapEvent = "{\"free\":" + String(heapEventFree) + ",\"largest\":" + String(heapEventLargest) + "}";
+    events.send(heapEvent.c_str(), "heap", heapEventMs);
+  }
+  heapEventPending = false;
+}
+
+// Read the FreeRTOS task list (needs configUSE_TRACE_FACILITY; CPU shares
+// also need configGENERATE_RUN_TIME_STATS)
+void sampleTaskStats() {
+#if defined(configUSE_TRACE_FACILITY) && configUSE_TRACE_FACILITY
+  static TaskStatus_t status[TASK_MAX_TRACKED];
+  static TaskSample samples[TASK_MAX_TRACKED];
+  uint32_t totalRunTime = 0;
+  
+  UBaseType_t count = uxTaskGetSystemState(status, TASK_MAX_TRACKED, &totalRunTime);
+  if (count == 0) {
+    taskTableOverflows++; // More tasks than TASK_MAX_TRACKED
+    return;
+  }
+  
+  for (UBaseType_t i = 0; i < count; i++) {
+    samples[i].id = status[i].xTaskNumber;
+    strncpy(samples[i].name, status[i].pcTaskName, sizeof(samples[i].name) - 1);
+    samples[i].name[sizeof(samples[i].name) - 1] = 0;
+    samples[i].runTime = status[i].ulRunTimeCounter;
+    samples[i].stackHighWater = status[i].usStackHighWaterMark;
+    samples[i].priority = status[i].uxCurrentPriority;
+#ifdef CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+    samples[i].core = (status[i].xCoreID == tskNO_AFFINITY) ? -1 : status[i].xCoreID;
+#else
+    samples[i].core = -1;
+#endif
+  }
+  
+  taskCpuStatsAvailable = totalRunTime != 0;
+  recordTaskSamples(samples, count, totalRunTime, portNUM_PROCESSORS);
+#endif
+}
+
+// Confidence from width match and contrast per scanline, agreement between
+// regions and consistency with the previous frame. Also counts outcomes.
+void computeDetectionConfidence(const ScanlineResult* results, size_t width) {
+  for (int i = 0; i < 4; i++) {
+    scanlineStateCounts[i][results[i].state]++;
+    scanlineStates[i] = results[i].state;
+    
+    if (results[i].state != SCANLINE_CROSSED) {
+      scanlineConfidence[i] = 0;
+      continue;
+    }
+    
+    // Width match: 100 at the expected width, 0 just outside the tolerance
+    // (lane rows span the lane, so width is not scored there)
+    int widthScore = 100;
+    if (!laneModeEnabled) {
+      int lineWidth = results[i].transitionEnd - results[i].transitionStart + 1;
+      int deviation = abs(lineWidth - scanlineLineWidths[i]);
+      widthScore = 100 - deviation * 100 / (frameLineTolerance + 1);
+      if (widthScore < 0) widthScore = 0;
+    }
+    
+    int contrastScore = scanlineContrast[i] * 100 / CONTRAST_FULL_SCORE;
+    if (contrastScore > 100) contrastScore = 100;
+    if (contrastScore < 0) contrastScore = 0;
+    
+    scanlineConfidence[i] = (widthScore + contrastScore) / 2;
+  }
+  
+  // Regions map to scanlines: top = 0, middle = 1 or 2, bottom = 3
+  int regionCenters[3] = {lineCenterTop, lineCenterMiddle, lineCenterBottom};
+  int regionBase[3];
+  regionBase[0] = scanlineConfidence[0];
+  regionBase[1] = (scanlineConfidence[1] > scanlineConfidence[2]) ? scanlineConfidence[1] : scanlineConfidence[2];
+  regionBase[2] = scanlineConfidence[3];
+  int maxShift = width / 4; // Shift between frames that scores 0
+  
+  int regionSum = 0;
+  int regionCount = 0;
+  for (int r = 0; r < 3; r++) {
+    if (regionCenters[r] < 0) {
+      regionConfidence[r] = 0;
+      continue;
+    }
+    // Centers found by the refined searches have no scanline score of their own;
+    // bridged centers are extrapolated, not seen, and get none at all
+    int base = (regionBase[r] > 0) ? regionBase[r] : 50;
+    if (regionBridged[r]) base = 0;
+    int temporalScore = 50; // Unknown without a previous detection
+    if (prevRegionCenters[r] >= 0) {
+      temporalScore = 100 - abs(regionCenters[r] - prevRegionCenters[r]) * 100 / maxShift;
+      if (temporalScore < 0) temporalScore = 0;
+    }
+    regionConfidence[r] = (3 * base + temporalScore) / 4;
+    regionSum += regionConfidence[r];
+    regionCount++;
+  }
+  
+  if (lineCenterX < 0 || !lineMeasured()) {
+    detectionConfidence = 0; // Nothing seen, or every center bridged
+  } else {
+    // Agreement: adjacent measured regions closer than maxShift agree
+    // (bridged ones lie on the fit and would always agree)
+    int agreementScore = 50; // Single region - nothing to compare
+    int pairs = 0;
+    int pairScore = 0;
+    for (int r = 0; r < 2; r++) {
+      if (regionCenters[r] >= 0 && regionCenters[r + 1] >= 0 && !regionBridged[r] && !regionBridged[r + 1]) {
+        int score = 100 - abs(regionCenters[r] - regionCenters[r + 1]) * 100 / maxShift;
+        pairScore += (score > 0) ? score : 0;
+        pairs++;
+      }
+    }
+    if (pairs > 0) agreementScore = pairScore / pairs;
+    
+    int temporalScore = 50;
+    if (prevLineCenterX >= 0) {
+      temporalScore = 100 - abs(lineCenterX - prevLineCenterX) * 100 / maxShift;
+      if (temporalScore < 0) temporalScore = 0;
+    }
+    
+    detectionConfidence = (3 * (regionSum / regionCount) + agreementScore + temporalScore) / 5;
+  }
+  
+  for (int r = 0; r < 3; r++) {
+    prevRegionCenters[r] = regionCenters[r];
+  }
+  prevLineCenterX = lineCenterX;
+}
+
+void resetScanlineStats() {
+  for (int i = 0; i < 4; i++) {
+    for (int j = 0; j < 4; j++) {
+      scanlineStateCounts[i][j] = 0;
+    }
+  }
+}
+
+// Bridge gaps of dashed lines. Region centers of this frame and of the last
+// gapBridgeMaxFrames frames are fitted with x = offset + slope * y; missing
+// regions within gapBridgeMaxPixels of a detected one (or all regions, when
+// nothing is detected in this frame) are filled from the fit. Observations
+// on a single row reuse the slope of a recent fit, or assume straight ahead.
+void bridgeLineGaps(const int* regionRows, size_t width) {
+  int* regionCenters[3] = {&lineCenterTop, &lineCenterMiddle, &lineCenterBottom};
+  lineBridged = false;
+  regionBridged[0] = regionBridged[1] = regionBridged[2] = false;
+  bridgeFrameCounter++;
+  
+  bool detected[3];
+  int present = 0;
+  for (int r = 0; r < 3; r++) {
+    detected[r] = (*regionCenters[r] >= 0);
+    if (!detected[r]) continue;
+    present++;
+    BridgeObservation& obs = bridgeHistory[bridgeHistoryHead];
+    obs.row = regionRows[r];
+    obs.x = *regionCenters[r];
+    obs.frame = bridgeFrameCounter;
+    bridgeHistoryHead = (bridgeHistoryHead + 1) % (3 * BRIDGE_HISTORY_FRAMES);
+  }
+  
+  if (!gapBridgingEnabled || present == 3) return;
+  
+  // Least squares over recent observations
+  int count = 0;
+  int minRow = 0x7FFF, maxRow = -1;
+  float sumY = 0, sumX = 0, sumYY = 0, sumXY = 0;
+  const BridgeObservation* newest = NULL;
+  for (int i = 0; i < 3 * BRIDGE_HISTORY_FRAMES; i++) {
+    const BridgeObservation& obs = bridgeHistory[i];
+    if (obs.frame == 0 || bridgeFrameCounter - obs.frame > (uint32_t)gapBridgeMaxFrames) continue;
+    float y = obs.row;
+    float x = obs.x;
+    sumY += y;
+    sumX += x;
+    sumYY += y * y;
+    sumXY += x * y;
+    count++;
+    if (obs.row < minRow) minRow = obs.row;
+    if (obs.row > maxRow) maxRow = obs.row;
+    if (newest == NULL || obs.frame > newest->frame) newest = &obs;
+  }
+  if (count == 0) return; // Gap is longer than gapBridgeMaxFrames
+  
+  float slope, offset;
+  if (maxRow > minRow) {
+    slope = (count * sumXY - sumX * sumY) / (count * sumYY - sumY * sumY);
+    offset = (sumX - slope * sumY) / count;
+    lastFitSlope = slope;
+    lastFitFrame = bridgeFrameCounter;
+  } else {
+    bool recentFit = (lastFitFrame > 0 && bridgeFrameCounter - lastFitFrame <= (uint32_t)gapBridgeMaxFrames);
+    slope = recentFit ? lastFitSlope : 0.0;
+    offset = newest->x - slope * newest->row;
+  }
+  
+  for (int r = 0; r < 3; r++) {
+    if (detected[r]) continue;
+    
+    // Limit extrapolation distance from the nearest region detected now
+    if (present > 0) {
+      int nearest = -1;
+      for (int k = 0; k < 3; k++) {
+        if (!detected[k]) continue;
+        int dist = abs(regionRows[k] - regionRows[r]);
+        if (nearest < 0 || dist < nearest) nearest = dist;
+      }
+      if (nearest > gapBridgeMaxPixels) continue;
+    }
+    
+    int x = (int)(offset + slope * regionRows[r] + 0.5);
+    if (x < 0 || x >= (int)width) continue;
+    *regionCenters[r] = x;
+    regionBridged[r] = true;
+    lineBridged = true;
+  }
+}
+
+// A region center was measured on the scanlines this frame; centers filled
+// by bridging are fits, so a frame with only those has no detected line
+bool lineMeasured() {
+  const int centers[3] = {lineCenterTop, lineCenterMiddle, lineCenterBottom};
+  for (int r = 0; r < 3; r++) {
+    if (centers[r] >= 0 && !regionBridged[r]) return true;
+  }
+  return false;
+}
+
+// lineCenterX was taken from a bridged region (same preference as the fuser)
+bool lineCenterFromFit() {
+  if (lineCenterBottom >= 0) return regionBridged[2];
+  if (lineCenterMiddle >= 0) return regionBridged[1];
+  if (lineCenterTop >= 0) return regionBridged[0];
+  return false;
+}
+
 // Wrapper function for backward compatibility
 void detectLineCenter(uint8_t* grayscale_buf, size_t width, size_t height) {
-  detectLineCenterWithScanlines(grayscale_buf, width, height);
+  selectDetectorPipeline()->fuse(grayscale_buf, width, height);
 }
 
 // Analyze line positions across regions to detect curves and calculate turn angle
 void detectCurveAndTurn(size_t width) {
+  PROFILE_REGION(PROF_CURVE);
   // Reset detection state
   curveAngle = 0.0;
   sharpTurnDetected = false;
@@ -554,6 +3584,29 @@ void detectCurveAndTurn(size_t width) {
     validComparisons++;
   }
   
+  // Near-field crossings (turn plans): slope of the line next to the robot,
+  // fitted through them and the bottom center, over the bottom-to-middle span
+  if (nearFieldCount > 0 && lineCenterBottom >= 0 && lineCenterMiddle >= 0) {
+    float sumX = lineCenterBottom, sumY = lineRegionRows[2];
+    float sumXY = sumX * sumY, sumYY = sumY * sumY;
+    int count = 1;
+    for (int i = 0; i < nearFieldCount; i++) {
+      if (nearFieldPoints[i].y == lineRegionRows[2]) continue; // Bottom stand-in
+      float x = nearFieldPoints[i].x, y = nearFieldPoints[i].y;
+      sumX += x;
+      sumY += y;
+      sumXY += x * y;
+      sumYY += y * y;
+      count++;
+    }
+    float denominator = count * sumYY - sumY * sumY;
+    if (count >= 2 && denominator > 0) {
+      float slope = (count * sumXY - sumX * sumY) / denominator; // x per row, rows grow downward
+      displacement += slope * (lineRegionRows[2] - lineRegionRows[1]);
+      validComparisons++;
+    }
+  }
+  
   if (validComparisons > 0) {
     displacement /= validComparisons;
     
@@ -580,6 +3633,81 @@ void detectCurveAndTurn(size_t width) {
   }
 }
 
+// Restore camera settings, calibration and learned line widths from NVS
+void loadSettings() {
+  preferences.begin("linedetect", true);
+  if (preferences.getBytesLength("camera") == sizeof(settings)) {
+    preferences.getBytes("camera", &settings, sizeof(settings));
+  }
+  binaryThreshold = preferences.getInt("threshold", binaryThreshold);
+  invertColors = preferences.getBool("invert", invertColors);
+  lineWidthLearningEnabled = preferences.getBool("learnWidth", lineWidthLearningEnabled);
+  
+  resetLearnedLineWidths();
+  learnedForFrameWidth = preferences.getInt("widthFrame", 0);
+  uint8_t widths[MAX_FRAME_ROWS];
+  if (learnedForFrameWidth > 0 && preferences.getBytesLength("widths") == sizeof(widths)) {
+    preferences.getBytes("widths", widths, sizeof(widths));
+    // Seed each row's ring with its stored median
+    for (int row = 0; row < MAX_FRAME_ROWS; row++) {
+      if (widths[row] == 0) continue;
+      for (int i = 0; i < LEARN_WIDTH_MIN_SAMPLES; i++) {
+        widthSamples[row][i] = widths[row];
+      }
+      widthSampleCount[row] = LEARN_WIDTH_MIN_SAMPLES;
+      widthSampleHead[row] = LEARN_WIDTH_MIN_SAMPLES;
+      learnedLineWidth[row] = widths[row];
+    }
+  }
+  if (preferences.getBytesLength("benchBase") == sizeof(benchBaseline)) {
+    preferences.getBytes("benchBase", benchBaseline, sizeof(benchBaseline));
+    benchHaveBaseline = true;
+  }
+  if (preferences.getBytesLength("golden") == sizeof(goldenApproved)) {
+    preferences.getBytes("golden", goldenApproved, sizeof(goldenApproved));
+    goldenHaveApproved = true;
+  }
+  preferences.end();
+}
+
+// Keep the latest benchmark results as the regression baseline
+void saveBenchBaseline() {
+  memcpy(benchBaseline, benchResults, sizeof(benchBaseline));
+  benchHaveBaseline = true;
+  preferences.begin("linedetect", false);
+  preferences.putBytes("benchBase", benchBaseline, sizeof(benchBaseline));
+  preferences.end();
+  Serial.println("Benchmark baseline saved");
+}
+
+// Approve the latest golden corpus outputs
+void saveGoldenOutputs() {
+  memcpy(goldenApproved, goldenActual, sizeof(goldenApproved));
+  goldenHaveApproved = true;
+  preferences.begin("linedetect", false);
+  preferences.putBytes("golden", goldenApproved, sizeof(goldenApproved));
+  preferences.end();
+  Serial.println("Golden outputs approved");
+}
+
+// Store camera settings, calibration and learned line widths in NVS
+void saveSettings() {
+  uint8_t widths[MAX_FRAME_ROWS];
+  for (int row = 0; row < MAX_FRAME_ROWS; row++) {
+    widths[row] = (widthSampleCount[row] >= LEARN_WIDTH_MIN_SAMPLES) ? learnedLineWidth[row] : 0;
+  }
+  
+  preferences.begin("linedetect", false);
+  preferences.putBytes("camera", &settings, sizeof(settings));
+  preferences.putInt("threshold", binaryThreshold);
+  preferences.putBool("invert", invertColors);
+  preferences.putBool("learnWidth", lineWidthLearningEnabled);
+  preferences.putInt("widthFrame", learnedForFrameWidth);
+  preferences.putBytes("widths", widths, sizeof(widths));
+  preferences.end();
+  Serial.println("Settings saved");
+}
+
 String getMainPage() {
   String html = R"rawliteral(
 <!DOCTYPE html>
@@ -701,6 +3829,7 @@ String getMainPage() {
         </div>
         <div class="controls">
             <button onclick="calibrate()">🎯 КАЛИБРОВКА</button>
+            <button onclick="saveSettings()">💾 СОХРАНИТЬ</button>
             <div class="control-group">
                 <label>Порог (Threshold):</label>
                 <input type="range" id="threshold" min="0" max="255" value="128" oninput="updateControl('threshold', this.value)">
@@ -747,6 +3876,13 @@ String getMainPage() {
                 });
         }
 
+        function saveSettings() {
+            fetch('/save')
+                .then(response => response.text())
+                .then(data => console.log('Settings saved'))
+                .catch(error => console.error('Save error:', error));
+        }
+
         function updateControl(control, value) {
             document.getElementById(control + 'Value').textContent = value;
             fetch('/control?name=' + control + '&value=' + value)
@@ -772,7 +3908,7 @@ String getMainPage() {
                     if (data.lineDetected) {
                         indicator.className = 'line-indicator line-detected';
                         lineStatus.textContent = 'Линия обнаружена!';
-                        positionStatus.textContent = 'Позиция: ' + data.lineCenterX + ' px';
+                        positionStatus.textContent = 'Позиция: ' + data.lineCenterX + ' px (уверенность ' + data.confidence + '%)';
                         
                         // Display turn information
                         let turnText = 'прямо';
@@ -782,7 +3918,9 @@ String getMainPage() {
                             turnText = '➡️ вправо';
                         }
                         
-                        if (data.sharpTurn) {
+                        if (data.cornerDetected) {
+                            turnText += ' (90°)';
+                        } else if (data.sharpTurn) {
                             turnText += ' (резкий!)';
                         }
                         
@@ -791,7 +3929,9 @@ String getMainPage() {
                     } else {
                         indicator.className = 'line-indicator line-not-detected';
                         lineStatus.textContent = 'Линия не обнаружена';
-                        positionStatus.textContent = 'Позиция: ---';
+                        positionStatus.textContent = data.lineCenterBridged
+                            ? 'Позиция: ' + data.lineCenterX + ' px (достроена по прошлым кадрам)'
+                            : 'Позиция: ---';
                         curveStatus.textContent = 'Поворот: ---';
                         angleStatus.textContent = 'Угол: ---';
                     }
@@ -844,55 +3984,873 @@ String getMainPage() {
   return html;
 }
 
+// Deterministic synthetic frame: noisy light floor with a dark line
+void fillBenchFrame(uint8_t* buf, size_t width, size_t height, int dataset) {
+  uint32_t seed = 12345;
+  for (size_t i = 0; i < width * height; i++) {
+    seed = seed * 1103515245 + 12345;
+    buf[i] = 180 + ((seed >> 16) % 50);
+  }
+  if (dataset == BENCH_EMPTY) return;
+  int halfWidth = width / 24 + 1;
+  for (size_t y = 0; y < height; y++) {
+    int center = width / 2;
+    if (dataset == BENCH_CURVE) {
+      float t = 1.0f - (float)y / height;  // 0 at the bottom
+      center += (int)(t * t * width * 0.6f);
+    }
+    for (int x = center - halfWidth; x <= center + halfWidth; x++) {
+      if (x >= 0 && x < (int)width) buf[y * width + x] = 30;
+    }
+  }
+}
+
+static uint32_t benchMedian(uint32_t* samples, int count) {
+  for (int i = 1; i < count; i++) {
+    uint32_t value = samples[i];
+    int j = i - 1;
+    while (j >= 0 && samples[j] > value) {
+      samples[j + 1] = samples[j];
+      j--;
+    }
+    samples[j + 1] = value;
+  }
+  return samples[count / 2];
+}
+
+// Detector state that carries over between frames (learned widths, lane
+// model, bridging history, plans, confidence history, counters) and the last
+// frame's outputs. Self-tests save it, run from a cleared state and put it
+// back, so the next live frame continues from where the last one left off;
+// /status and the other handlers are refused while the run holds the detector.
+struct DetectorState {
+  uint8_t widthSamples[MAX_FRAME_ROWS][LEARN_WIDTH_SAMPLES];
+  uint8_t widthSampleCount[MAX_FRAME_ROWS];
+  uint8_t widthSampleHead[MAX_FRAME_ROWS];
+  uint8_t learnedLineWidth[MAX_FRAME_ROWS];
+  int learnedForFrameWidth;
+  int scanlineLineWidths[4];
+  int frameLineWidth;
+  int frameLineTolerance;
+  int16_t laneWidthByRow[MAX_FRAME_ROWS];
+  int16_t laneCenterByRow[MAX_FRAME_ROWS];
+  int laneWidthBottom;
+  bool laneBoundaryMissing;
+  BridgeObservation bridgeHistory[3 * BRIDGE_HISTORY_FRAMES];
+  int bridgeHistoryHead;
+  uint32_t bridgeFrameCounter;
+  float lastFitSlope;
+  uint32_t lastFitFrame;
+  bool lineBridged;
+  bool regionBridged[3];
+  ScanlinePlan scanlinePlans[PLAN_SPEED_LEVELS][PLAN_CURVE_LEVELS];
+  ScanlinePlan fixedScanlinePlan;
+  int scanlinePlanWidth;
+  int scanlinePlanHeight;
+  const ScanlinePlan* activeScanlinePlan;
+  const DetectorPipeline* activeDetectorPipeline;
+  int lineCenterX;
+  int lineCenterTop;
+  int lineCenterMiddle;
+  int lineCenterBottom;
+  int lineRegionRows[3];
+  float curveAngle;
+  bool sharpTurnDetected;
+  char turnDirection[12];
+  int scanlineConfidence[4];
+  int regionConfidence[3];
+  int detectionConfidence;
+  int prevRegionCenters[3];
+  int prevLineCenterX;
+  uint32_t scanlineStateCounts[4][4];
+  uint8_t scanlineStates[4];
+  bool cornerDetected;
+  char cornerExitSide[8];
+  int cornerExitY;
+  TracePoint tracePoints[TRACE_MAX_POINTS];
+  int traceLength;
+  TracePoint nearFieldPoints[NEAR_FIELD_MAX_POINTS];
+  int nearFieldCount;
+  float traceTurnAngle;
+  float traceCurvature;
+  PathWaypoint pathWaypoints[PATH_WAYPOINTS];
+  int pathWaypointCount;
+};
+DetectorState* savedDetectorState = NULL; // Live state while a self-test runs (PSRAM)
+
+// Frame and JSON buffers of /bench and /golden, allocated on first use
+bool allocBenchBuffers() {
+  size_t frameBytes = PACKED_MAX_WIDTH * PACKED_MAX_HEIGHT;
+  if (benchSource == NULL) {
+    benchSource = (uint8_t*)heap_caps_malloc(frameBytes, MALLOC_CAP_SPIRAM);
+    benchFrame = (uint8_t*)heap_caps_malloc(frameBytes, MALLOC_CAP_SPIRAM);
+    benchJsonBuffer = (char*)heap_caps_malloc(BENCH_JSON_SIZE, MALLOC_CAP_SPIRAM);
+    savedDetectorState = (DetectorState*)heap_caps_malloc(sizeof(DetectorState), MALLOC_CAP_SPIRAM);
+  }
+  return benchSource != NULL && benchFrame != NULL && benchJsonBuffer != NULL && savedDetectorState != NULL;
+}
+
+#define SAVE_STATE(field) memcpy(&state->field, &field, sizeof(state->field))
+#define RESTORE_STATE(field) memcpy(&field, &state->field, sizeof(field))
+
+void saveDetectorState(DetectorState* state) {
+  SAVE_STATE(widthSamples);
+  SAVE_STATE(widthSampleCount);
+  SAVE_STATE(widthSampleHead);
+  SAVE_STATE(learnedLineWidth);
+  SAVE_STATE(learnedForFrameWidth);
+  SAVE_STATE(scanlineLineWidths);
+  SAVE_STATE(frameLineWidth);
+  SAVE_STATE(frameLineTolerance);
+  SAVE_STATE(laneWidthByRow);
+  SAVE_STATE(laneCenterByRow);
+  SAVE_STATE(laneWidthBottom);
+  SAVE_STATE(laneBoundaryMissing);
+  SAVE_STATE(bridgeHistory);
+  SAVE_STATE(bridgeHistoryHead);
+  SAVE_STATE(bridgeFrameCounter);
+  SAVE_STATE(lastFitSlope);
+  SAVE_STATE(lastFitFrame);
+  SAVE_STATE(lineBridged);
+  SAVE_STATE(regionBridged);
+  SAVE_STATE(scanlinePlans);
+  SAVE_STATE(fixedScanlinePlan);
+  SAVE_STATE(scanlinePlanWidth);
+  SAVE_STATE(scanlinePlanHeight);
+  SAVE_STATE(activeScanlinePlan);
+  SAVE_STATE(activeDetectorPipeline);
+  SAVE_STATE(lineCenterX);
+  SAVE_STATE(lineCenterTop);
+  SAVE_STATE(lineCenterMiddle);
+  SAVE_STATE(lineCenterBottom);
+  SAVE_STATE(lineRegionRows);
+  SAVE_STATE(curveAngle);
+  SAVE_STATE(sharpTurnDetected);
+  snprintf(state->turnDirection, sizeof(state->turnDirection), "%s", turnDirection.c_str());
+  SAVE_STATE(scanlineConfidence);
+  SAVE_STATE(regionConfidence);
+  SAVE_STATE(detectionConfidence);
+  SAVE_STATE(prevRegionCenters);
+  SAVE_STATE(prevLineCenterX);
+  SAVE_STATE(scanlineStateCounts);
+  SAVE_STATE(scanlineStates);
+  SAVE_STATE(cornerDetected);
+  snprintf(state->cornerExitSide, sizeof(state->cornerExitSide), "%s", cornerExitSide.c_str());
+  SAVE_STATE(cornerExitY);
+  SAVE_STATE(tracePoints);
+  SAVE_STATE(traceLength);
+  SAVE_STATE(nearFieldPoints);
+  SAVE_STATE(nearFieldCount);
+  SAVE_STATE(traceTurnAngle);
+  SAVE_STATE(traceCurvature);
+  SAVE_STATE(pathWaypoints);
+  SAVE_STATE(pathWaypointCount);
+}
+
+void restoreDetectorState(const DetectorState* state) {
+  RESTORE_STATE(widthSamples);
+  RESTORE_STATE(widthSampleCount);
+  RESTORE_STATE(widthSampleHead);
+  RESTORE_STATE(learnedLineWidth);
+  RESTORE_STATE(learnedForFrameWidth);
+  RESTORE_STATE(scanlineLineWidths);
+  RESTORE_STATE(frameLineWidth);
+  RESTORE_STATE(frameLineTolerance);
+  RESTORE_STATE(laneWidthByRow);
+  RESTORE_STATE(laneCenterByRow);
+  RESTORE_STATE(laneWidthBottom);
+  RESTORE_STATE(laneBoundaryMissing);
+  RESTORE_STATE(bridgeHistory);
+  RESTORE_STATE(bridgeHistoryHead);
+  RESTORE_STATE(bridgeFrameCounter);
+  RESTORE_STATE(lastFitSlope);
+  RESTORE_STATE(lastFitFrame);
+  RESTORE_STATE(lineBridged);
+  RESTORE_STATE(regionBridged);
+  RESTORE_STATE(scanlinePlans);
+  RESTORE_STATE(fixedScanlinePlan);
+  RESTORE_STATE(scanlinePlanWidth);
+  RESTORE_STATE(scanlinePlanHeight);
+  RESTORE_STATE(activeScanlinePlan);
+  RESTORE_STATE(activeDetectorPipeline);
+  RESTORE_STATE(lineCenterX);
+  RESTORE_STATE(lineCenterTop);
+  RESTORE_STATE(lineCenterMiddle);
+  RESTORE_STATE(lineCenterBottom);
+  RESTORE_STATE(lineRegionRows);
+  RESTORE_STATE(curveAngle);
+  RESTORE_STATE(sharpTurnDetected);
+  turnDirection = state->turnDirection;
+  RESTORE_STATE(scanlineConfidence);
+  RESTORE_STATE(regionConfidence);
+  RESTORE_STATE(detectionConfidence);
+  RESTORE_STATE(prevRegionCenters);
+  RESTORE_STATE(prevLineCenterX);
+  RESTORE_STATE(scanlineStateCounts);
+  RESTORE_STATE(scanlineStates);
+  RESTORE_STATE(cornerDetected);
+  cornerExitSide = state->cornerExitSide;
+  RESTORE_STATE(cornerExitY);
+  RESTORE_STATE(tracePoints);
+  RESTORE_STATE(traceLength);
+  RESTORE_STATE(nearFieldPoints);
+  RESTORE_STATE(nearFieldCount);
+  RESTORE_STATE(traceTurnAngle);
+  RESTORE_STATE(traceCurvature);
+  RESTORE_STATE(pathWaypoints);
+  RESTORE_STATE(pathWaypointCount);
+}
+
+#undef SAVE_STATE
+#undef RESTORE_STATE
+
+// Forget everything one frame passes to the next, so a self-test starts from
+// the same state as the first frame after boot
+void clearDetectorHistory() {
+  resetLearnedLineWidths();
+  learnedForFrameWidth = 0;
+  resetLaneModel();
+  memset(bridgeHistory, 0, sizeof(bridgeHistory));
+  bridgeHistoryHead = 0;
+  bridgeFrameCounter = 0;
+  lastFitSlope = 0.0;
+  lastFitFrame = 0;
+  scanlinePlanWidth = 0;  // Rebuilt for the first self-test frame
+  scanlinePlanHeight = 0;
+  activeScanlinePlan = &fixedScanlinePlan;
+  for (int i = 0; i < 3; i++) prevRegionCenters[i] = -1;
+  prevLineCenterX = -1;
+  curveAngle = 0.0;
+  sharpTurnDetected = false;
+  turnDirection = "straight";
+  traceLength = 0;
+}
+
+// Put settings that change detector work or outputs (or carry state between
+// frames) to their defaults; returns the live values for restorePinnedSettings
+PinnedSettings pinDefaultSettings() {
+  PinnedSettings saved = {detectorLogEnabled, binaryThreshold, invertColors, glareMaskEnabled, lineWidthLearningEnabled,
+                          gapBridgingEnabled, laneModeEnabled, adaptiveScanlinesEnabled, pyramidFactor,
+                          lineTracerEnabled, columnScanEnabled, morphFilter, temporalFilterFrames};
+  detectorLogEnabled = false; // Serial output would be timed with the kernels
+  binaryThreshold = 128;
+  invertColors = false;
+  glareMaskEnabled = false;
+  lineWidthLearningEnabled = false;
+  gapBridgingEnabled = false;
+  laneModeEnabled = false;
+  adaptiveScanlinesEnabled = false;
+  pyramidFactor = 4;
+  lineTracerEnabled = true;
+  columnScanEnabled = true;
+  morphFilter = MORPH_NONE;
+  temporalFilterFrames = 0;
+  selectDetectorPipeline(); // Pinned invertColors and glareMaskEnabled pick the pipeline
+  return saved;
+}
+
+void restorePinnedSettings(const PinnedSettings& saved) {
+  detectorLogEnabled = saved.log;
+  binaryThreshold = saved.threshold;
+  invertColors = saved.invert;
+  glareMaskEnabled = saved.glare;
+  lineWidthLearningEnabled = saved.learning;
+  gapBridgingEnabled = saved.bridging;
+  laneModeEnabled = saved.lane;
+  adaptiveScanlinesEnabled = saved.adaptivePlan;
+  pyramidFactor = saved.pyramid;
+  lineTracerEnabled = saved.tracer;
+  columnScanEnabled = saved.columnScan;
+  morphFilter = saved.morph;
+  temporalFilterFrames = saved.temporal;
+}
+
+// Ticks of BENCH_BATCH passes of analyzeScanline over BENCH_SCANLINE_ROWS
+// evenly spaced rows of benchFrame
+static uint32_t timeScanlineBatch(size_t width, size_t height) {
+  const int rows = BENCH_SCANLINE_ROWS;
+  uint32_t start = profileCounter();
+  for (int b = 0; b < BENCH_BATCH; b++) {
+    for (int k = 0; k < rows; k++) {
+      analyzeScanline(benchFrame, width, height, (2 * k + 1) * height / (2 * rows));
+    }
+  }
+  return profileCounter() - start;
+}
+
+// Ticks of BENCH_BATCH detectLineCenterWithScanlines calls on benchFrame
+static uint32_t timeDetectBatch(size_t width, size_t height) {
+  uint32_t start = profileCounter();
+  for (int b = 0; b < BENCH_BATCH; b++) {
+    resetFrameArena();
+    detectLineCenterWithScanlines(benchFrame, width, height);
+  }
+  return profileCounter() - start;
+}
+
+// Byte-per-pixel reference for BENCH_MORPH_BYTES: 3x3 erosion or dilation,
+// separable like morphPacked3x3, pixels outside the frame do not constrain it
+static void morphBytes3x3(uint8_t* buf, uint8_t* scratch, size_t width, size_t height, bool erode) {
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  uint8_t fieldColor = 255 - lineColor;
+  int w = width;
+  for (int y = 0; y < (int)height; y++) {
+    const uint8_t* in = buf + y * w;
+    uint8_t* out = scratch + y * w;
+    for (int x = 0; x < w; x++) {
+      bool left = (x > 0) ? in[x - 1] == lineColor : erode;
+      bool right = (x < w - 1) ? in[x + 1] == lineColor : erode;
+      bool center = in[x] == lineColor;
+      out[x] = (erode ? (left && center && right) : (left || center || right)) ? lineColor : fieldColor;
+    }
+  }
+  for (int y = 0; y < (int)height; y++) {
+    const uint8_t* above = scratch + (y > 0 ? y - 1 : y) * w;
+    const uint8_t* row = scratch + y * w;
+    const uint8_t* below = scratch + (y < (int)height - 1 ? y + 1 : y) * w;
+    uint8_t* out = buf + y * w;
+    for (int x = 0; x < w; x++) {
+      bool a = above[x] == lineColor, c = row[x] == lineColor, b = below[x] == lineColor;
+      out[x] = (erode ? (a && c && b) : (a || c || b)) ? lineColor : fieldColor;
+    }
+  }
+}
+
+// Byte-per-pixel reference for BENCH_TEMPORAL_BYTES: store the frame in the
+// history and replace it with the per-pixel majority of the last n frames
+static void temporalMajorityBytes(uint8_t* buf, size_t len, int n, int head) {
+  uint8_t lineColor = activeDetectorPipeline->lineColor;
+  uint8_t fieldColor = 255 - lineColor;
+  size_t stride = PACKED_MAX_WIDTH * PACKED_MAX_HEIGHT;
+  memcpy(benchHistory + head * stride, buf, len);
+  memset(buf, 0, len);  // buf counts the votes, one frame at a time
+  for (int k = 0; k < n; k++) {
+    const uint8_t* frame = benchHistory + k * stride;
+    for (size_t i = 0; i < len; i++) buf[i] += frame[i] == lineColor;
+  }
+  for (size_t i = 0; i < len; i++) buf[i] = (2 * buf[i] > n) ? lineColor : fieldColor;
+}
+
+// benchSource as a YUYV frame with neutral chroma
+static void fillBenchYuv(size_t width, size_t height) {
+  for (size_t i = 0; i < width * height; i += 2) {
+    benchYuv[2 * i] = benchSource[i];
+    benchYuv[2 * i + 1] = 128;
+    benchYuv[2 * i + 2] = benchSource[i + 1];
+    benchYuv[2 * i + 3] = 128;
+  }
+}
+
+// The /stream detection steps on a grayscale frame, up to the path (with
+// LINE_SRAM_ROWS only the planned rows may be binarized by then)
+static void benchDetectFrame(uint8_t* gray, size_t width, size_t height) {
+  frameSequence++;
+  resetFrameArena();
+  if (!stageScanlineRows(gray, width, height)) {
+    selectDetectorPipeline()->binarize(gray, width, height);
+  }
+  detectLineCenterWithScanlines(gray, width, height);
+}
+
+// Run every kernel, size and dataset with pinned settings from a cleared
+// detector state; the live state is put back afterwards. The temporal filter
+// ring is filled with bench frames, so the live filter starts over.
+bool runKernelBenchmarks() {
+  if (!allocBenchBuffers()) return false;
+  size_t frameBytes = PACKED_MAX_WIDTH * PACKED_MAX_HEIGHT;
+  benchHistory = (uint8_t*)heap_caps_malloc(TEMPORAL_MAX_FRAMES * frameBytes, MALLOC_CAP_SPIRAM);
+  benchYuv = (uint8_t*)heap_caps_malloc(2 * frameBytes, MALLOC_CAP_SPIRAM);
+  if (benchHistory == NULL || benchYuv == NULL) {
+    free(benchHistory);
+    free(benchYuv);
+    benchHistory = NULL;
+    benchYuv = NULL;
+    return false;
+  }
+  
+  saveDetectorState(savedDetectorState);
+  clearDetectorHistory();
+  PinnedSettings saved = pinDefaultSettings();
+  int pinnedPyramid = pyramidFactor;
+  uint32_t samples[BENCH_KERNEL_COUNT][BENCH_REPEATS];
+  for (int s = 0; s < BENCH_SIZE_COUNT; s++) {
+    size_t width = benchSizes[s][0];
+    size_t height = benchSizes[s][1];
+    ensureFrameArena(width, height);
+    for (int d = 0; d < BENCH_DATASET_COUNT; d++) {
+      fillBenchFrame(benchSource, width, height, d);
+      fillBenchYuv(width, height);
+      frameSequence++;  // New frame for the per-frame caches (packed frame, staged rows)
+      for (int r = 0; r < BENCH_REPEATS; r++) {
+        memcpy(benchFrame, benchSource, width * height);
+        uint32_t start = profileCounter();
+        convertTo1Bit(benchFrame, width * height);
+        samples[BENCH_BINARIZE][r] = profileCounter() - start;
+        
+        // Rows and whole frames with the pinned pyramid factor, then the
+        // other factors (frames narrower than PYRAMID_MIN_WIDTH scan flat anyway)
+        samples[BENCH_SCANLINE][r] = timeScanlineBatch(width, height) / benchCallsPerSample[BENCH_SCANLINE];
+        pyramidFactor = 2;
+        samples[BENCH_SCANLINE_PYRAMID2][r] = timeScanlineBatch(width, height) / benchCallsPerSample[BENCH_SCANLINE_PYRAMID2];
+        samples[BENCH_DETECT_PYRAMID2][r] = timeDetectBatch(width, height) / benchCallsPerSample[BENCH_DETECT_PYRAMID2];
+        pyramidFactor = 0;
+        samples[BENCH_SCANLINE_FLAT][r] = timeScanlineBatch(width, height) / benchCallsPerSample[BENCH_SCANLINE_FLAT];
+        samples[BENCH_DETECT_FLAT][r] = timeDetectBatch(width, height) / benchCallsPerSample[BENCH_DETECT_FLAT];
+        pyramidFactor = pinnedPyramid;
+        samples[BENCH_DETECT][r] = timeDetectBatch(width, height) / benchCallsPerSample[BENCH_DETECT];
+        
+        // Tracer alone, seeded like the detector: nearest region center found
+        // by the 4 scanlines (none on the empty frames, so only the seed check runs)
+        int seedX = lineCenterBottom, seedRow = lineRegionRows[2];
+        if (seedX < 0) {
+          seedX = (lineCenterMiddle >= 0) ? lineCenterMiddle : lineCenterTop;
+          seedRow = (lineCenterMiddle >= 0) ? lineRegionRows[1] : lineRegionRows[0];
+        }
+        start = profileCounter();
+        for (int b = 0; b < BENCH_BATCH; b++) {
+          traceLineFromBottom(benchFrame, width, height, seedX, seedRow);
+        }
+        samples[BENCH_TRACER][r] = (profileCounter() - start) / benchCallsPerSample[BENCH_TRACER];
+        
+        // Corner columns: transposed strips of a packed frame (as left by the
+        // binary filters) against strided reads of the byte frame
+        int rightColumn = width - BENCH_EDGE_COLUMN - 1;
+        resetFrameArena();
+        packBinaryFrame(benchFrame, width, height);
+        start = profileCounter();
+        for (int b = 0; b < BENCH_BATCH; b++) {
+          transposedStrips = 0;
+          benchSink += analyzeColumn(BENCH_EDGE_COLUMN).state + analyzeColumn(rightColumn).state;
+        }
+        samples[BENCH_COLUMNS][r] = (profileCounter() - start) / benchCallsPerSample[BENCH_COLUMNS];
+        
+        start = profileCounter();
+        for (int b = 0; b < BENCH_BATCH; b++) {
+          benchSink += analyzeColumnBytes(benchFrame, width, height, BENCH_EDGE_COLUMN).state +
+                       analyzeColumnBytes(benchFrame, width, height, rightColumn).state;
+        }
+        samples[BENCH_COLUMNS_STRIDED][r] = (profileCounter() - start) / benchCallsPerSample[BENCH_COLUMNS_STRIDED];
+        
+        // Binary filters on the packed frame, packing and unpacking
+        // included, against byte-per-pixel references
+        resetFrameArena();
+        morphFilter = MORPH_OPEN_CLOSE;
+        start = profileCounter();
+        applyBinaryFilters(benchFrame, width, height);
+        samples[BENCH_MORPH][r] = profileCounter() - start;
+        morphFilter = MORPH_NONE;
+        
+        start = profileCounter();
+        morphBytes3x3(benchFrame, benchHistory, width, height, true);
+        morphBytes3x3(benchFrame, benchHistory, width, height, false);
+        morphBytes3x3(benchFrame, benchHistory, width, height, false);
+        morphBytes3x3(benchFrame, benchHistory, width, height, true);
+        samples[BENCH_MORPH_BYTES][r] = profileCounter() - start;
+        
+        temporalFilterFrames = TEMPORAL_MAX_FRAMES;
+        if (r == 0) {
+          for (int f = 0; f < TEMPORAL_MAX_FRAMES - 1; f++) applyBinaryFilters(benchFrame, width, height);
+        }
+        start = profileCounter();
+        applyBinaryFilters(benchFrame, width, height);
+        samples[BENCH_TEMPORAL][r] = profileCounter() - start;
+        temporalFilterFrames = 0;
+        
+        if (r == 0) {
+          for (int f = 0; f < TEMPORAL_MAX_FRAMES; f++) memcpy(benchHistory + f * frameBytes, benchFrame, width * height);
+        }
+        start = profileCounter();
+        temporalMajorityBytes(benchFrame, width * height, TEMPORAL_MAX_FRAMES, r % TEMPORAL_MAX_FRAMES);
+        samples[BENCH_TEMPORAL_BYTES][r] = profileCounter() - start;
+        
+        // Whole frame from the camera's format: grayscale is binarized in
+        // place, YUV422 is split into the luma plane first (lumaFromFrame)
+        memcpy(benchFrame, benchSource, width * height);
+        start = profileCounter();
+        benchDetectFrame(benchFrame, width, height);
+        samples[BENCH_FRAME_GRAY_PATH][r] = profileCounter() - start;
+        
+        memcpy(benchFrame, benchSource, width * height);
+        start = profileCounter();
+        benchDetectFrame(benchFrame, width, height);
+        finishBinarization();
+        samples[BENCH_FRAME_GRAY][r] = profileCounter() - start;
+        
+        samples[BENCH_FRAME_YUV][r] = 0;
+        if (lumaBuffer != NULL && colorClassMap != NULL) {
+          start = profileCounter();
+          deinterleaveYUV422(benchYuv, width, height);
+          benchDetectFrame(lumaBuffer, width, height);
+          finishBinarization();
+          samples[BENCH_FRAME_YUV][r] = profileCounter() - start;
+        }
+        
+        uint8_t* jpg = NULL;
+        size_t jpgLength = 0;
+        start = profileCounter();
+        bool encoded = fmt2jpg(benchFrame, width * height, width, height, PIXFORMAT_GRAYSCALE, 80, &jpg, &jpgLength);
+        samples[BENCH_JPEG][r] = profileCounter() - start;
+        if (encoded) free(jpg);
+      }
+      for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+        uint32_t minTicks = UINT32_MAX;
+        for (int r = 0; r < BENCH_REPEATS; r++) {
+          if (samples[k][r] < minTicks) minTicks = samples[k][r];
+        }
+        benchResults[k][s][d].minTicks = minTicks;
+        benchResults[k][s][d].medianTicks = benchMedian(samples[k], BENCH_REPEATS);
+      }
+    }
+  }
+  
+  restorePinnedSettings(saved);
+  restoreDetectorState(savedDetectorState);
+  resetTemporalFilter();
+  free(benchHistory);
+  free(benchYuv);
+  benchHistory = NULL;
+  benchYuv = NULL;
+  return true;
+}
+
+// A case regressed when its minimum exceeds the baseline by more than the
+// kernel's tolerance and by more than the counter noise of one sample (the
+// per-call difference times the calls the sample timed)
+static bool benchRegressed(int k, int s, int d) {
+  if (!benchHaveBaseline || benchBaseline[k][s][d].minTicks == 0) return false;
+  uint32_t baseline = benchBaseline[k][s][d].minTicks;
+  uint32_t minTicks = benchResults[k][s][d].minTicks;
+  return (uint64_t)minTicks * 100 > (uint64_t)baseline * (100 + benchTolerancePct[k]) &&
+         (uint64_t)(minTicks - baseline) * benchCallsPerSample[k] > BENCH_MIN_DELTA_TICKS;
+}
+
+bool benchPassed() {
+  for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+    for (int s = 0; s < BENCH_SIZE_COUNT; s++) {
+      for (int d = 0; d < BENCH_DATASET_COUNT; d++) {
+        if (benchRegressed(k, s, d)) return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Results as JSON with the baseline comparison; *passed is false when any
+// minimum exceeds its baseline by more than the kernel's tolerance
+size_t formatBenchJson(char* out, size_t size, bool* passed) {
+  size_t len = 0;
+  *passed = true;
+  jsonAppend(out, size, len, "{\"unit\":\"%s\",\"repeats\":%d,\"baseline\":%s,\"results\":[",
+             PROFILE_UNIT, BENCH_REPEATS, benchHaveBaseline ? "true" : "false");
+  bool first = true;
+  for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+    for (int s = 0; s < BENCH_SIZE_COUNT; s++) {
+      for (int d = 0; d < BENCH_DATASET_COUNT; d++) {
+        const BenchResult& result = benchResults[k][s][d];
+        jsonAppend(out, size, len, "%s{\"kernel\":\"%s\",\"width\":%u,\"height\":%u,\"dataset\":\"%s\",\"min\":%lu,\"median\":%lu",
+                   first ? "" : ",", benchKernelNames[k], benchSizes[s][0], benchSizes[s][1],
+                   benchDatasetNames[d], (unsigned long)result.minTicks, (unsigned long)result.medianTicks);
+        first = false;
+        uint32_t baseline = benchHaveBaseline ? benchBaseline[k][s][d].minTicks : 0;
+        if (baseline > 0) {
+          bool regressed = benchRegressed(k, s, d);
+          if (regressed) *passed = false;
+          jsonAppend(out, size, len, ",\"baselineMin\":%lu,\"ratio\":%.3f,\"tolerance\":%u,\"regressed\":%s",
+                     (unsigned long)baseline, (double)result.minTicks / baseline,
+                     benchTolerancePct[k], regressed ? "true" : "false");
+        }
+        jsonAppend(out, size, len, "}");
+      }
+    }
+  }
+  jsonAppend(out, size, len, "],\"pass\":%s}", *passed ? "true" : "false");
+  
+  if (len >= size) {
+    snprintf(out, size, "{\"error\":\"benchmark table too large\"}");
+    len = strlen(out);
+  }
+  return len;
+}
+
+// Current detector outputs in comparable form
+void captureDetectionSnapshot(DetectionSnapshot& snapshot) {
+  snapshot.centers[0] = lineCenterX;
+  snapshot.centers[1] = lineCenterTop;
+  snapshot.centers[2] = lineCenterMiddle;
+  snapshot.centers[3] = lineCenterBottom;
+  memcpy(snapshot.states, scanlineStates, sizeof(snapshot.states));
+  snapshot.curveAngleCenti = (int16_t)(curveAngle * 100);
+  snapshot.turn = (turnDirection == "left") ? -1 : (turnDirection == "right" ? 1 : 0);
+  snapshot.corner = cornerDetected;
+}
+
+// True when actual matches expected: centers and angle within tolerance,
+// found/lost centers, states, turn and corner exactly
+bool detectionSnapshotMatches(const DetectionSnapshot& expected, const DetectionSnapshot& actual) {
+  for (int i = 0; i < 4; i++) {
+    if ((expected.centers[i] < 0) != (actual.centers[i] < 0)) return false;
+    if (abs(expected.centers[i] - actual.centers[i]) > goldenCenterTolerance) return false;
+    if (expected.states[i] != actual.states[i]) return false;
+  }
+  return abs(expected.curveAngleCenti - actual.curveAngleCenti) <= goldenAngleToleranceCenti &&
+         expected.turn == actual.turn && expected.corner == actual.corner;
+}
+
+// Run the detector over the synthetic corpus (bench sizes x datasets) from a
+// cleared state, keeping outputs and ticks per frame; the live state is put
+// back afterwards
+bool runGoldenCorpus() {
+  if (!allocBenchBuffers()) return false;
+  saveDetectorState(savedDetectorState);
+  clearDetectorHistory();
+  PinnedSettings saved = pinDefaultSettings();
+  for (int s = 0; s < BENCH_SIZE_COUNT; s++) {
+    size_t width = benchSizes[s][0];
+    size_t height = benchSizes[s][1];
+    ensureFrameArena(width, height);
+    for (int d = 0; d < BENCH_DATASET_COUNT; d++) {
+      int f = s * BENCH_DATASET_COUNT + d;
+      fillBenchFrame(benchFrame, width, height, d);
+      frameSequence++;
+      resetFrameArena();
+      uint32_t start = profileCounter();
+      convertTo1Bit(benchFrame, width * height);
+      detectLineCenterWithScanlines(benchFrame, width, height);
+      goldenTicks[f] = profileCounter() - start;
+      captureDetectionSnapshot(goldenActual[f]);
+    }
+  }
+  restorePinnedSettings(saved);
+  restoreDetectorState(savedDetectorState);
+  return true;
+}
+
+bool goldenPassed() {
+  if (!goldenHaveApproved) return false;
+  for (int f = 0; f < GOLDEN_FRAMES; f++) {
+    if (!detectionSnapshotMatches(goldenApproved[f], goldenActual[f])) return false;
+  }
+  return true;
+}
+
+static void appendSnapshotJson(char* out, size_t size, size_t& len, const char* key, const DetectionSnapshot& snapshot) {
+  jsonAppend(out, size, len, ",\"%s\":{\"centers\":[%d,%d,%d,%d],\"states\":[%u,%u,%u,%u],\"angle\":%.2f,\"turn\":%d,\"corner\":%s}",
+             key, snapshot.centers[0], snapshot.centers[1], snapshot.centers[2], snapshot.centers[3],
+             snapshot.states[0], snapshot.states[1], snapshot.states[2], snapshot.states[3],
+             snapshot.curveAngleCenti / 100.0, snapshot.turn, snapshot.corner ? "true" : "false");
+}
+
+// Corpus results as JSON: per-frame match, outputs and ticks, plus the
+// summary (matched frames, mean ticks per frame)
+size_t formatGoldenJson(char* out, size_t size, bool* passed) {
+  size_t len = 0;
+  int matched = 0;
+  uint64_t totalTicks = 0;
+  jsonAppend(out, size, len, "{\"unit\":\"%s\",\"approved\":%s,\"centerTolerance\":%d,\"angleTolerance\":%.2f,\"frames\":[",
+             PROFILE_UNIT, goldenHaveApproved ? "true" : "false", goldenCenterTolerance,
+             goldenAngleToleranceCenti / 100.0);
+  for (int f = 0; f < GOLDEN_FRAMES; f++) {
+    int s = f / BENCH_DATASET_COUNT;
+    int d = f % BENCH_DATASET_COUNT;
+    bool match = goldenHaveApproved && detectionSnapshotMatches(goldenApproved[f], goldenActual[f]);
+    if (match) matched++;
+    totalTicks += goldenTicks[f];
+    jsonAppend(out, size, len, "%s{\"width\":%u,\"height\":%u,\"dataset\":\"%s\",\"ticks\":%lu,\"match\":%s",
+               f ? "," : "", benchSizes[s][0], benchSizes[s][1], benchDatasetNames[d],
+               (unsigned long)goldenTicks[f], match ? "true" : "false");
+    appendSnapshotJson(out, size, len, "actual", goldenActual[f]);
+    if (goldenHaveApproved && !match) {
+      appendSnapshotJson(out, size, len, "expected", goldenApproved[f]);
+    }
+    jsonAppend(out, size, len, "}");
+  }
+  *passed = goldenHaveApproved && matched == GOLDEN_FRAMES;
+  jsonAppend(out, size, len, "],\"matched\":%d,\"total\":%d,\"meanTicks\":%lu,\"pass\":%s}",
+             matched, GOLDEN_FRAMES, (unsigned long)(totalTicks / GOLDEN_FRAMES), *passed ? "true" : "false");
+  
+  if (len >= size) {
+    snprintf(out, size, "{\"error\":\"golden table too large\"}");
+    len = strlen(out);
+  }
+  return len;
+}
+
+// Run a self-test queued by a handler (called from loop()). Waits for the
+// current /stream frame to finish, then holds the detector for the run.
+void runPendingSelfTest() {
+  int test = selfTestPending;
+  if (test == SELF_TEST_NONE) return;
+  while (!tryClaimDetector()) {
+    delay(1);
+  }
+  selfTestRunning = true;
+  selfTestPending = SELF_TEST_NONE;
+  
+  bool golden = (test == SELF_TEST_GOLDEN || test == SELF_TEST_GOLDEN_APPROVE);
+  bool ran = golden ? runGoldenCorpus() : runKernelBenchmarks();
+  benchBuffersFailed = !ran;
+  if (ran && golden) {
+    goldenHaveResults = true;
+    if (test == SELF_TEST_GOLDEN_APPROVE) saveGoldenOutputs();
+  } else if (ran) {
+    benchHaveResults = true;
+    if (test == SELF_TEST_BENCH_SAVE) saveBenchBaseline();
+  }
+  
+  selfTestRunning = false;
+  releaseDetector();
+  selfTestFinished = test;
+  
+  if (!ran) {
+    Serial.println("Benchmark buffers not allocated");
+  } else if (golden) {
+    Serial.printf("Golden check %s\n", goldenPassed() ? "passed" : "failed");
+  } else {
+    Serial.printf("Benchmark %s\n", benchPassed() ? "passed" : "regressed");
+  }
+}
+
+// Announce a finished self-test on /events; called from async_tcp handlers only
+void publishSelfTestEvent() {
+  int test = selfTestFinished;
+  if (test == SELF_TEST_NONE) return;
+  selfTestFinished = SELF_TEST_NONE;
+  if (events.count() == 0) return;
+  bool golden = (test == SELF_TEST_GOLDEN || test == SELF_TEST_GOLDEN_APPROVE);
+  bool passed = !benchBuffersFailed && (golden ? goldenPassed() : benchPassed());
+  bool saved = (test == SELF_TEST_BENCH_SAVE || test == SELF_TEST_GOLDEN_APPROVE);
+  String testEvent = "{\"ok\":" + String(benchBuffersFailed ? "false" : "true") + ",\"pass\":" +
+                     String(passed ? "true" : "false") + ",\"saved\":" + String(saved ? "true" : "false") + "}";
+  events.send(testEvent.c_str(), golden ? "golden" : "bench", millis());
+}
+
 void setupRoutes() {
   // Main page
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
-    request->send(200, "text/html", getMainPage());
+    String page = getMainPage();
+    allocStats.pageResponses++;
+    allocStats.pageBytes += page.length();
+    request->send(200, "text/html", page);
   });
 
   // Camera stream - returns 1-bit processed image as JPEG
   server.on("/stream", HTTP_GET, [](AsyncWebServerRequest *request) {
+    PROFILE_REGION(PROF_STREAM);
+    // A self-test in loop() is using the detector globals
+    DetectorClaim claim;
+    if (!claim.owned) {
+      request->send(503, "text/plain", "Self-test running");
+      return;
+    }
     // FIXED: LED flash disabled - not needed for now
     // digitalWrite(LED_FLASH, HIGH);
     // delay(10);
     
-    camera_fb_t * fb = esp_camera_fb_get();
+    camera_fb_t * fb;
+    {
+      PROFILE_REGION(PROF_CAPTURE);
+      fb = esp_camera_fb_get();
+    }
     if (!fb) {
+      frameStats.droppedCapture++;
       // digitalWrite(LED_FLASH, LOW);
       request->send(500, "text/plain", "Camera capture failed");
       return;
     }
+    accountFetchedFrame(fb);
     
-    if (fb->format != PIXFORMAT_GRAYSCALE) {
+    // Grayscale frames are used in place, YUV422 frames are split into
+    // a luma plane (line detection) and chroma classes (color markers)
+    uint8_t* gray = lumaFromFrame(fb);
+    if (gray == NULL) {
+      frameStats.droppedFormat++;
       esp_camera_fb_return(fb);
       // digitalWrite(LED_FLASH, LOW);
-      request->send(500, "text/plain", "Expected grayscale format");
+      request->send(500, "text/plain", "Expected grayscale or YUV422 format");
       return;
     }
     
-    // Convert to 1-bit
-    convertTo1Bit(fb->buf, fb->len);
+    frameSequence++;
+    ensureFrameArena(fb->width, fb->height);
+    resetFrameArena();
+    
+    // Contrast and the field edge are only visible before binarization
+    measureScanlineContrast(gray, fb->width, fb->height);
+    if (boundaryMonitorEnabled) {
+      monitorFieldBoundary(gray, fb->width, fb->height);
+      if (boundaryEventFrame == frameSequence && events.count() > 0) {
+        String boundaryEvent = "{\"frame\":" + String(frameSequence) + ",\"sides\":" + String(boundarySides) + "}";
+        events.send(boundaryEvent.c_str(), "boundary", frameSequence);
+      }
+    } else {
+      boundarySides = 0;
+    }
+    
+    // Binarize only the planned rows, into internal SRAM, when nothing
+    // needs the whole binary frame before detection (LINE_SRAM_ROWS)
+    uint32_t cycleStart = ESP.getCycleCount();
+    bool rowsStaged = stageScanlineRows(gray, fb->width, fb->height);
+    uint32_t cycleStaged = ESP.getCycleCount();
+    if (!rowsStaged) {
+      // Convert to 1-bit (and mark glare in the same pass)
+      selectDetectorPipeline()->binarize(gray, fb->width, fb->height);
+      
+      // Remove binarization noise and flicker before analysis
+      applyBinaryFilters(gray, fb->width, fb->height);
+    }
+    uint32_t cycleBinarized = ESP.getCycleCount();
     
     // Detect line center
-    detectLineCenter(fb->buf, fb->width, fb->height);
+    detectLineCenter(gray, fb->width, fb->height);
+    uint32_t cycleDetected = ESP.getCycleCount();
+    frameStats.processed++;
+    
+    // Publish the path to event subscribers
+    if (events.count() > 0) {
+      String pathEvent = "{\"frame\":" + String(frameSequence) + ",\"captured\":" + String(frameStats.captured) +
+                         ",\"dropped\":" + String(droppedFrameCount()) + ",\"path\":" + pathToJson() + "}";
+      events.send(pathEvent.c_str(), "path", frameSequence);
+    }
+    publishHeapEvent();
+    publishSelfTestEvent();
+    
+    // The overlay and the JPEG show the whole binary frame; with staged rows
+    // it is binarized here, after the path went out
+    uint32_t cycleFinishStart = ESP.getCycleCount();
+    finishBinarization();
+    recordStageCycles(binarizeCycles, (cycleBinarized - cycleStaged) + (ESP.getCycleCount() - cycleFinishStart));
+    recordStageCycles(stageCycles, cycleStaged - cycleStart);
+    recordStageCycles(detectCycles, cycleDetected - cycleBinarized);
+    
+    // Show glare-masked pixels as gray
+    const uint32_t* mask = glareMaskRow(fb->width, 0);
+    if (mask != NULL && glarePixelCount > 0) {
+      for (size_t i = 0; i < fb->width * fb->height; i++) {
+        size_t x = i % fb->width;
+        const uint32_t* maskRow = mask + (i / fb->width) * PACKED_WORDS(fb->width);
+        if ((maskRow[x >> 5] >> (x & 31)) & 1) {
+          gray[i] = 128;
+        }
+      }
+    }
+    
+    // Overlay coordinates are signed (-1 = not found)
+    const int frameWidth = fb->width;
+    const int frameHeight = fb->height;
     
-    // Visualize scanning lines (4 horizontal lines with 5-pixel offset)
+    // Visualize scanning lines (rows of this frame's scanline plan)
     const int EDGE_OFFSET = 5;
-    int scanlines[4];
-    scanlines[0] = EDGE_OFFSET;                    // Top scanline
-    scanlines[1] = fb->height / 3;                  // Upper-middle scanline
-    scanlines[2] = (2 * fb->height) / 3;           // Lower-middle scanline
-    scanlines[3] = fb->height - EDGE_OFFSET - 1;   // Bottom scanline
+    const int16_t* scanlines = activeScanlinePlan->rows;
     
     // Draw scanning lines in inverted color
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < activeScanlinePlan->count; i++) {
       int row = scanlines[i];
-      if (row >= 0 && row < fb->height) {
-        for (int x = 0; x < fb->width; x++) {
-          int idx = row * fb->width + x;
+      if (row >= 0 && row < frameHeight) {
+        for (int x = 0; x < frameWidth; x++) {
+          int idx = row * frameWidth + x;
           // Invert every 3rd pixel to make a dotted line
           if (x % 3 == 0) {
-            fb->buf[idx] = (fb->buf[idx] == 0) ? 255 : 0;
+            gray[idx] = (gray[idx] == 0) ? 255 : 0;
           }
         }
       }
@@ -900,45 +4858,51 @@ void setupRoutes() {
     
     // Draw detection indicators for detected line centers
     // Bottom region (close) - vertical line in inverted color
-    if (lineCenterBottom >= 0 && lineCenterBottom < fb->width) {
-      int bottomRow = (2 * fb->height) / 3;
-      for (int y = bottomRow; y < fb->height - EDGE_OFFSET; y++) {
+    if (lineCenterBottom >= 0 && lineCenterBottom < frameWidth) {
+      int bottomRow = (2 * frameHeight) / 3;
+      for (int y = bottomRow; y < frameHeight - EDGE_OFFSET; y++) {
         for (int dx = -1; dx <= 1; dx++) {
           int x = lineCenterBottom + dx;
-          if (x >= 0 && x < fb->width) {
-            int idx = y * fb->width + x;
-            fb->buf[idx] = (fb->buf[idx] == 0) ? 255 : 0;
+          if (x >= 0 && x < frameWidth) {
+            int idx = y * frameWidth + x;
+            gray[idx] = (gray[idx] == 0) ? 255 : 0;
           }
         }
       }
     }
     
     // Middle region - vertical line in inverted color
-    if (lineCenterMiddle >= 0 && lineCenterMiddle < fb->width) {
-      for (int y = fb->height / 3; y < (2 * fb->height) / 3; y++) {
+    if (lineCenterMiddle >= 0 && lineCenterMiddle < frameWidth) {
+      for (int y = frameHeight / 3; y < (2 * frameHeight) / 3; y++) {
         int x = lineCenterMiddle;
-        if (x >= 0 && x < fb->width) {
-          int idx = y * fb->width + x;
-          fb->buf[idx] = (fb->buf[idx] == 0) ? 255 : 0;
+        if (x >= 0 && x < frameWidth) {
+          int idx = y * frameWidth + x;
+          gray[idx] = (gray[idx] == 0) ? 255 : 0;
         }
       }
     }
     
     // Top region (far ahead) - vertical line in inverted color
-    if (lineCenterTop >= 0 && lineCenterTop < fb->width) {
-      for (int y = EDGE_OFFSET; y < fb->height / 3; y++) {
+    if (lineCenterTop >= 0 && lineCenterTop < frameWidth) {
+      for (int y = EDGE_OFFSET; y < frameHeight / 3; y++) {
         int x = lineCenterTop;
-        if (x >= 0 && x < fb->width) {
-          int idx = y * fb->width + x;
-          fb->buf[idx] = (fb->buf[idx] == 0) ? 255 : 0;
+        if (x >= 0 && x < frameWidth) {
+          int idx = y * frameWidth + x;
+          gray[idx] = (gray[idx] == 0) ? 255 : 0;
         }
       }
     }
     
-    // Draw connecting line between detected regions to visualize curve
-    if (lineCenterBottom >= 0 && lineCenterTop >= 0) {
+    // Draw traced centerline polyline (dotted) to visualize the curve
+    if (traceLength >= 2) {
+      for (int i = 0; i < traceLength; i++) {
+        int idx = tracePoints[i].y * frameWidth + tracePoints[i].x;
+        gray[idx] = (gray[idx] == 0) ? 255 : 0;
+      }
+    } else if (lineCenterBottom >= 0 && lineCenterTop >= 0) {
+      // Fall back to connecting line between detected regions
       // Simple line drawing between bottom and top
-      int startY = fb->height - EDGE_OFFSET - 1;
+      int startY = frameHeight - EDGE_OFFSET - 1;
       int endY = EDGE_OFFSET;
       int startX = lineCenterBottom;
       int endX = lineCenterTop;
@@ -946,9 +4910,9 @@ void setupRoutes() {
       for (int y = endY; y < startY; y += 2) {
         float t = (float)(y - endY) / (startY - endY);
         int x = startX + (int)(t * (endX - startX));
-        if (x >= 0 && x < fb->width && y >= 0 && y < fb->height) {
-          int idx = y * fb->width + x;
-          fb->buf[idx] = (fb->buf[idx] == 0) ? 255 : 0;
+        if (x >= 0 && x < frameWidth && y >= 0 && y < frameHeight) {
+          int idx = y * frameWidth + x;
+          gray[idx] = (gray[idx] == 0) ? 255 : 0;
         }
       }
     }
@@ -956,12 +4920,22 @@ void setupRoutes() {
     // Convert 1-bit grayscale to JPEG for transmission
     uint8_t * out_jpg = NULL;
     size_t out_jpg_len = 0;
-    if (frame2jpg(fb, 80, &out_jpg, &out_jpg_len)) {
+    bool encoded;
+    {
+      PROFILE_REGION(PROF_JPEG);
+      encoded = fmt2jpg(gray, fb->width * fb->height, fb->width, fb->height, PIXFORMAT_GRAYSCALE, 80, &out_jpg, &out_jpg_len);
+    }
+    if (encoded) {
+      allocStats.jpegBuffers++;
+      allocStats.jpegBytes += out_jpg_len;
+      accountServedFrame(fb);
       AsyncWebServerResponse *response = request->beginResponse(200, "image/jpeg", out_jpg, out_jpg_len);
       response->addHeader("Access-Control-Allow-Origin", "*");
       request->send(response);
       free(out_jpg);
     } else {
+      frameStats.droppedEncode++;
+      allocStats.jpegFailures++;
       request->send(500, "text/plain", "JPEG conversion failed");
     }
     
@@ -969,8 +4943,200 @@ void setupRoutes() {
     // digitalWrite(LED_FLASH, LOW);
   });
 
+  // Binary telemetry record of the latest path
+  server.on("/path.bin", HTTP_GET, [](AsyncWebServerRequest *request) {
+    DetectorClaim claim;
+    if (!claim.owned) {
+      request->send(503, "text/plain", "Self-test running");
+      return;
+    }
+    static PathTelemetryRecord record;
+    record.magic = PATH_RECORD_MAGIC;
+    record.version = PATH_RECORD_VERSION;
+    record.count = pathWaypointCount;
+    record.frame = frameSequence;
+    record.timestampMs = millis();
+    record.framesCaptured = frameStats.captured;
+    record.framesProcessed = frameStats.processed;
+    record.framesDropped = droppedFrameCount();
+    record.framesStale = frameStats.staleServed;
+    record.frameAgeMs = (lastFrameAgeUs / 1000 > 65535) ? 65535 : lastFrameAgeUs / 1000;
+    record.heapInternalFreeKb = heapLatest.internal.freeBytes / 1024;
+    record.heapInternalLargestKb = heapLatest.internal.largestBlock / 1024;
+    record.heapPsramFreeKb = (heapLatest.psram.freeBytes / 1024 > 65535) ? 65535 : heapLatest.psram.freeBytes / 1024;
+    record.heapWarning = heapWarning;
+    for (int k = 0; k < PATH_WAYPOINTS; k++) {
+      const PathWaypoint& wp = pathWaypoints[k];
+      bool valid = k < pathWaypointCount;
+      record.waypoints[k].x = valid ? (int16_t)(wp.x * 10) : 0;
+      record.waypoints[k].y = valid ? (int16_t)(wp.y * 10) : 0;
+      record.waypoints[k].heading = valid ? (int16_t)(wp.heading * 100) : 0;
+      record.waypoints[k].groundX = valid ? (int16_t)constrain(wp.groundX, -32768.0, 32767.0) : 0;
+      record.waypoints[k].groundY = valid ? (int16_t)constrain(wp.groundY, -32768.0, 32767.0) : -1;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/octet-stream", (const uint8_t*)&record, sizeof(record));
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    request->send(response);
+  });
+
+  // Heap history (oldest first): [uptime s, internal free, internal largest, PSRAM free, PSRAM largest]
+  server.on("/heap", HTTP_GET, [](AsyncWebServerRequest *request) {
+    publishHeapEvent();
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->printf("{\"warnKb\":%d,\"warning\":%s,\"internalMin\":%lu,\"psramMin\":%lu,\"samples\":[",
+                     heapWarnInternalKb, heapWarning ? "true" : "false",
+                     (unsigned long)heapLatest.internal.minimumFree, (unsigned long)heapLatest.psram.minimumFree);
+    for (int k = 0; k < heapRingCount; k++) {
+      const HeapSample& h = heapRing[(heapRingHead + HEAP_RING_SAMPLES - heapRingCount + k) % HEAP_RING_SAMPLES];
+      response->printf("%s[%lu,%lu,%lu,%lu,%lu]", k ? "," : "", (unsigned long)h.uptimeS, (unsigned long)h.internal.freeBytes,
+                       (unsigned long)h.internal.largestBlock, (unsigned long)h.psram.freeBytes, (unsigned long)h.psram.largestBlock);
+    }
+    response->print("]}");
+    request->send(response);
+  });
+
+  // Per-task CPU utilization and stack high-water marks
+  server.on("/tasks", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (taskJsonBuffer == NULL) {
+      request->send(500, "text/plain", "Task monitor buffer not allocated");
+      return;
+    }
+    formatTaskStatsJson(taskJsonBuffer, TASK_JSON_SIZE, portNUM_PROCESSORS);
+    request->send(200, "application/json", taskJsonBuffer);
+  });
+
+  // Cycle profile of the instrumented regions (builds with -DLINE_PROFILE=1);
+  // /profile?reset=1 clears the table after reporting it
+  server.on("/profile", HTTP_GET, [](AsyncWebServerRequest *request) {
+#if LINE_PROFILE
+    static char profileJson[PROFILE_JSON_SIZE];
+    formatProfileJson(profileJson, sizeof(profileJson));
+    if (request->hasParam("reset")) {
+      resetProfileStats();
+    }
+    request->send(200, "application/json", profileJson);
+#else
+    request->send(200, "application/json", "{\"enabled\":false}");
+#endif
+  });
+
+  // Kernel benchmark against the stored baseline. /bench?run=1 queues a run
+  // in loop() (?save=1 also stores it as the baseline) and answers 202;
+  // /bench then returns the last run: 200 when every minimum is within
+  // tolerance, 422 on a regression
+  server.on("/bench", HTTP_GET, [](AsyncWebServerRequest *request) {
+    publishSelfTestEvent();
+    if (request->hasParam("run") || request->hasParam("save")) {
+      if (selfTestPending == SELF_TEST_NONE && !selfTestRunning) {
+        selfTestPending = request->hasParam("save") ? SELF_TEST_BENCH_SAVE : SELF_TEST_BENCH;
+      }
+      request->send(202, "text/plain", "Benchmark queued, GET /bench for the result");
+      return;
+    }
+    if (selfTestPending != SELF_TEST_NONE || selfTestRunning) {
+      request->send(202, "text/plain", "Self-test running");
+      return;
+    }
+    if (benchBuffersFailed) {
+      request->send(500, "text/plain", "Benchmark buffers not allocated");
+      return;
+    }
+    if (!benchHaveResults) {
+      request->send(404, "text/plain", "No benchmark run yet, start one with /bench?run=1");
+      return;
+    }
+    bool passed;
+    formatBenchJson(benchJsonBuffer, BENCH_JSON_SIZE, &passed);
+    request->send(passed ? 200 : 422, "application/json", benchJsonBuffer);
+  });
+
+  // Detector outputs on the synthetic corpus against the approved set.
+  // /golden?run=1 queues a run in loop() (?approve=1 also approves its
+  // outputs) and answers 202; /golden then returns the last run: 200 when
+  // all frames match, 422 otherwise
+  server.on("/golden", HTTP_GET, [](AsyncWebServerRequest *request) {
+    publishSelfTestEvent();
+    if (request->hasParam("run") || request->hasParam("approve")) {
+      if (selfTestPending == SELF_TEST_NONE && !selfTestRunning) {
+        selfTestPending = request->hasParam("approve") ? SELF_TEST_GOLDEN_APPROVE : SELF_TEST_GOLDEN;
+      }
+      request->send(202, "text/plain", "Golden check queued, GET /golden for the result");
+      return;
+    }
+    if (selfTestPending != SELF_TEST_NONE || selfTestRunning) {
+      request->send(202, "text/plain", "Self-test running");
+      return;
+    }
+    if (benchBuffersFailed) {
+      request->send(500, "text/plain", "Benchmark buffers not allocated");
+      return;
+    }
+    if (!goldenHaveResults) {
+      request->send(404, "text/plain", "No golden run yet, start one with /golden?run=1");
+      return;
+    }
+    bool passed;
+    formatGoldenJson(benchJsonBuffer, BENCH_JSON_SIZE, &passed);
+    request->send(passed ? 200 : 422, "application/json", benchJsonBuffer);
+  });
+
+  // Raw luma of one frame as binary PGM, to record a corpus for host runs;
+  // the comment line holds the threshold and line color it was taken with
+  server.on("/frame.pgm", HTTP_GET, [](AsyncWebServerRequest *request) {
+    DetectorClaim claim;
+    if (!claim.owned) {
+      request->send(503, "text/plain", "Self-test running");
+      return;
+    }
+    if (framePgmBuffer == NULL) {
+      framePgmBuffer = (uint8_t*)heap_caps_malloc(FRAME_PGM_HEADER + PACKED_MAX_WIDTH * MAX_FRAME_ROWS, MALLOC_CAP_SPIRAM);
+    }
+    camera_fb_t * fb = esp_camera_fb_get();
+    if (!fb) {
+      frameStats.droppedCapture++;
+      request->send(500, "text/plain", "Camera capture failed");
+      return;
+    }
+    accountFetchedFrame(fb);
+    uint8_t* gray = lumaFromFrame(fb);
+    if (gray == NULL || framePgmBuffer == NULL || !detectorFrameSupported(fb->width, fb->height)) {
+      esp_camera_fb_return(fb);
+      request->send(500, "text/plain", "Frame not recordable");
+      return;
+    }
+    int header = snprintf((char*)framePgmBuffer, FRAME_PGM_HEADER, "P5\n# threshold=%d invert=%d\n%u %u\n255\n",
+                          binaryThreshold, invertColors ? 1 : 0, (unsigned)fb->width, (unsigned)fb->height);
+    memcpy(framePgmBuffer + header, gray, fb->width * fb->height);
+    size_t length = header + fb->width * fb->height;
+    esp_camera_fb_return(fb);
+    request->send(request->beginResponse(200, "image/x-portable-graymap", framePgmBuffer, length));
+  });
+
+  // Timeline of the last seconds as Chrome trace_event JSON (builds with
+  // -DLINE_TRACE=1); /trace?seconds=N, default 5
+  server.on("/trace", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (traceJsonBuffer == NULL) {
+      request->send(200, "application/json", "{\"traceEvents\":[]}");
+      return;
+    }
+    int seconds = 5;
+    if (request->hasParam("seconds")) {
+      seconds = constrain(request->getParam("seconds")->value().toInt(), 1, 60);
+    }
+    size_t len = formatTraceJson(traceJsonBuffer, TRACE_JSON_SIZE, seconds * 1000000UL);
+    AsyncWebServerResponse *response = request->beginResponse(200, "application/json", (uint8_t*)traceJsonBuffer, len);
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    request->send(response);
+  });
+
   // Control endpoint - handles slider updates
   server.on("/control", HTTP_GET, [](AsyncWebServerRequest *request) {
+    // A self-test would overwrite the change when it restores its pinned settings
+    DetectorClaim claim;
+    if (!claim.owned) {
+      request->send(503, "text/plain", "Self-test running");
+      return;
+    }
     if (request->hasParam("name") && request->hasParam("value")) {
       String name = request->getParam("name")->value();
       int value = request->getParam("value")->value().toInt();
@@ -986,6 +5152,118 @@ void setupRoutes() {
         settings.contrast = constrain(value, -2, 2);
         applyCameraSettings();
         Serial.printf("Contrast updated to: %d\n", settings.contrast);
+      } else if (name == "heapWarnKb") {
+        heapWarnInternalKb = constrain(value, 0, 256);
+        Serial.printf("Heap warning threshold updated to: %d KB\n", heapWarnInternalKb);
+      } else if (name == "boundary") {
+        boundaryMonitorEnabled = (value != 0);
+        Serial.printf("Boundary monitor %s\n", boundaryMonitorEnabled ? "enabled" : "disabled");
+      } else if (name == "boundaryDelta") {
+        boundaryDelta = constrain(value, 10, 200);
+        Serial.printf("Boundary delta updated to: %d\n", boundaryDelta);
+      } else if (name == "cameraHeight") {
+        cameraHeightMm = constrain(value, 0, 2000);
+        Serial.printf("Camera height updated to: %d mm\n", cameraHeightMm);
+      } else if (name == "cameraPitch") {
+        cameraPitchDeg = constrain(value, 0, 89);
+        Serial.printf("Camera pitch updated to: %d\n", cameraPitchDeg);
+      } else if (name == "cameraFov") {
+        cameraHfovDeg = constrain(value, 20, 160);
+        Serial.printf("Camera FOV updated to: %d\n", cameraHfovDeg);
+      } else if (name == "speed") {
+        commandedSpeed = constrain(value, 0, 100);
+      } else if (name == "adaptiveScanlines") {
+        adaptiveScanlinesEnabled = (value != 0);
+        Serial.printf("Adaptive scanlines %s\n", adaptiveScanlinesEnabled ? "enabled" : "disabled");
+      } else if (name == "glare") {
+        glareMaskEnabled = (value != 0);
+        Serial.printf("Glare mask %s\n", glareMaskEnabled ? "enabled" : "disabled");
+      } else if (name == "glareLevel") {
+        glareLevel = constrain(value, 128, 255);
+        Serial.printf("Glare level updated to: %d\n", glareLevel);
+      } else if (name == "gapPixels") {
+        gapBridgeMaxPixels = constrain(value, 0, 240);
+        gapBridgingEnabled = (gapBridgeMaxPixels > 0);
+        Serial.printf("Gap bridging max pixels: %d\n", gapBridgeMaxPixels);
+      } else if (name == "gapFrames") {
+        gapBridgeMaxFrames = constrain(value, 0, BRIDGE_HISTORY_FRAMES - 1);
+        Serial.printf("Gap bridging max frames: %d\n", gapBridgeMaxFrames);
+      } else if (name == "detectLog") {
+        detectorLogEnabled = (value != 0);
+        Serial.printf("Per-frame detector log %s\n", detectorLogEnabled ? "enabled" : "disabled");
+      } else if (name == "benchTolerance") {
+        for (int k = 0; k < BENCH_KERNEL_COUNT; k++) {
+          if (k != BENCH_JPEG) benchTolerancePct[k] = constrain(value, 0, 200);
+        }
+        Serial.printf("Benchmark tolerance: %d%%\n", benchTolerancePct[0]);
+      } else if (name == "benchJpegTolerance") {
+        benchTolerancePct[BENCH_JPEG] = constrain(value, 0, 200);
+        Serial.printf("Benchmark JPEG tolerance: %d%%\n", benchTolerancePct[BENCH_JPEG]);
+      } else if (name == "goldenTolerance") {
+        goldenCenterTolerance = constrain(value, 0, 50);
+        Serial.printf("Golden center tolerance: %d px\n", goldenCenterTolerance);
+      } else if (name == "trace") {
+        traceEnabled = (value > 0);
+        Serial.printf("Tracing %s\n", traceEnabled ? "enabled" : "disabled");
+      } else if (name == "traceMask") {
+        traceRegionMask = (uint32_t)value;
+        Serial.printf("Trace region mask: 0x%lx\n", (unsigned long)traceRegionMask);
+      } else if (name == "sensorFps") {
+        sensorFrameRate = constrain(value, 0, 120);
+        resetFrameStats();  // Re-estimate the period with the new rate
+        Serial.printf("Sensor frame rate: %d fps\n", sensorFrameRate);
+      } else if (name == "resetStats") {
+        resetScanlineStats();
+        resetFrameStats();
+        resetProfileStats();
+        Serial.println("Scanline, frame and profile statistics reset");
+      } else if (name == "learnWidth") {
+        lineWidthLearningEnabled = (value > 0);
+        if (value < 0) resetLearnedLineWidths(); // -1 = forget and disable
+        Serial.printf("Line width learning %s\n", lineWidthLearningEnabled ? "enabled" : "disabled");
+      } else if (name == "laneMode") {
+        laneModeEnabled = (value != 0);
+        resetLaneModel();
+        Serial.printf("Lane mode %s\n", laneModeEnabled ? "enabled" : "disabled");
+      } else if (name == "colorMode") {
+        int mode = (value != 0) ? 1 : 0;
+        if (mode != settings.colorMode) {
+          // Pixel format is fixed at init, so the camera is restarted
+          int previousMode = settings.colorMode;
+          settings.colorMode = mode;
+          esp_camera_deinit();
+          bool ok = initCamera();
+          if (!ok) {
+            // Bring the camera back in the mode it was running in
+            settings.colorMode = previousMode;
+            esp_camera_deinit();
+            initCamera();
+          }
+          resetTemporalFilter();
+          if (!ok) {
+            Serial.printf("Color mode switch failed, staying in %s\n", settings.colorMode ? "YUV422" : "grayscale");
+            request->send(500, "text/plain", s ? "Camera restart failed, previous color mode restored"
+                                               : "Camera restart failed");
+            return;
+          }
+        }
+        Serial.printf("Color mode updated to: %s\n", settings.colorMode ? "YUV422" : "grayscale");
+      } else if (name == "temporal") {
+        temporalFilterFrames = (value >= 5) ? 5 : (value >= 3 ? 3 : 0);
+        resetTemporalFilter();
+        Serial.printf("Temporal filter updated to: %d frames\n", temporalFilterFrames);
+      } else if (name == "morph") {
+        morphFilter = constrain(value, (int)MORPH_NONE, (int)MORPH_OPEN_CLOSE);
+        Serial.printf("Morphological filter updated to: %d\n", morphFilter);
+      } else if (name == "pyramid") {
+        pyramidFactor = (value >= 4) ? 4 : (value >= 2 ? 2 : 0);
+        Serial.printf("Pyramid factor updated to: %d\n", pyramidFactor);
+      } else if (name == "tracer") {
+        lineTracerEnabled = (value != 0);
+        Serial.printf("Line tracer %s\n", lineTracerEnabled ? "enabled" : "disabled");
+      } else if (name == "columnScan") {
+        columnScanEnabled = (value != 0);
+        Serial.printf("Column scan %s\n", columnScanEnabled ? "enabled" : "disabled");
       }
       
       request->send(200, "text/plain", "OK");
@@ -994,28 +5272,150 @@ void setupRoutes() {
     }
   });
 
+  // Save settings and learned parameters to flash
+  server.on("/save", HTTP_GET, [](AsyncWebServerRequest *request) {
+    // Would store the self-test's pinned settings
+    DetectorClaim claim;
+    if (!claim.owned) {
+      request->send(503, "text/plain", "Self-test running");
+      return;
+    }
+    saveSettings();
+    request->send(200, "text/plain", "Settings saved");
+  });
+
   // Calibration endpoint
   server.on("/calibrate", HTTP_GET, [](AsyncWebServerRequest *request) {
+    DetectorClaim claim;
+    if (!claim.owned) {
+      request->send(503, "text/plain", "Self-test running");
+      return;
+    }
     calibrateCamera();
     request->send(200, "text/plain", "Calibration complete");
   });
   
   // Status endpoint - returns current detection status
   server.on("/status", HTTP_GET, [](AsyncWebServerRequest *request) {
+    PROFILE_REGION(PROF_STATUS);
+    publishHeapEvent();
+    publishSelfTestEvent();
+    // Detector outputs are mid-update while a self-test runs
+    DetectorClaim claim;
+    if (!claim.owned) {
+      request->send(503, "text/plain", "Self-test running");
+      return;
+    }
     String json = "{";
     json += "\"threshold\":" + String(binaryThreshold) + ",";
     json += "\"brightness\":" + String(settings.brightness) + ",";
     json += "\"contrast\":" + String(settings.contrast) + ",";
     json += "\"invertColors\":" + String(invertColors ? "true" : "false") + ",";
-    json += "\"lineDetected\":" + String(lineCenterX >= 0 ? "true" : "false") + ",";
+    json += "\"lineDetected\":" + String(lineMeasured() ? "true" : "false") + ",";
     json += "\"lineCenterX\":" + String(lineCenterX) + ",";
+    json += "\"confidence\":" + String(detectionConfidence) + ",";
+    json += "\"scanlineRows\":[";
+    for (int i = 0; i < activeScanlinePlan->count; i++) {
+      if (i > 0) json += ",";
+      json += String(activeScanlinePlan->rows[i]);
+    }
+    json += "],";
+    json += "\"pipeline\":\"" + String(activeDetectorPipeline->name) + "\",";
+    json += "\"glarePixels\":" + String(glareMaskEnabled ? glarePixelCount : 0) + ",";
+    json += "\"lineBridged\":" + String(lineBridged ? "true" : "false") + ",";
+    json += "\"lineCenterBridged\":" + String(lineCenterFromFit() ? "true" : "false") + ",";
+    json += "\"regionConfidence\":[" + String(regionConfidence[0]) + "," + String(regionConfidence[1]) + "," +
+            String(regionConfidence[2]) + "],";
     json += "\"lineCenterTop\":" + String(lineCenterTop) + ",";
     json += "\"lineCenterMiddle\":" + String(lineCenterMiddle) + ",";
     json += "\"lineCenterBottom\":" + String(lineCenterBottom) + ",";
     json += "\"curveAngle\":" + String(curveAngle, 1) + ",";
     json += "\"sharpTurn\":" + String(sharpTurnDetected ? "true" : "false") + ",";
-    json += "\"turnDirection\":\"" + turnDirection + "\"";
+    json += "\"turnDirection\":\"" + turnDirection + "\",";
+    json += "\"cornerDetected\":" + String(cornerDetected ? "true" : "false") + ",";
+    json += "\"cornerExitSide\":\"" + cornerExitSide + "\",";
+    json += "\"cornerExitY\":" + String(cornerExitY) + ",";
+    json += "\"traceTurnAngle\":" + String(traceTurnAngle, 1) + ",";
+    json += "\"traceCurvature\":" + String(traceCurvature, 4) + ",";
+    json += "\"trace\":[";
+    for (int i = 0; i < traceLength; i++) {
+      if (i > 0) json += ",";
+      json += "[" + String(tracePoints[i].x) + "," + String(tracePoints[i].y) + "]";
+    }
+    json += "],";
+    json += "\"path\":" + pathToJson() + ",";
+    // Cycles per frame stage for this build's memory placement
+    json += "\"cycles\":{\"iram\":" + String(LINE_HOT_IRAM ? "true" : "false") + ",";
+    json += "\"sramRows\":" + String(LINE_SRAM_ROWS ? "true" : "false") + ",";
+    json += "\"binarize\":" + String(binarizeCycles.last) + ",\"binarizeMean\":" + String(binarizeCycles.mean) + ",";
+    json += "\"stage\":" + String(stageCycles.last) + ",\"stageMean\":" + String(stageCycles.mean) + ",";
+    json += "\"detect\":" + String(detectCycles.last) + ",\"detectMean\":" + String(detectCycles.mean) + "},";
+    json += "\"arena\":{\"capacity\":" + String(frameArena.capacity) + ",\"used\":" + String(frameArena.used) +
+            ",\"highWater\":" + String(frameArena.highWater) + ",\"failures\":" + String(frameArena.failures) + "},";
+    // Heap telemetry (last sample) and per-request allocations
+    json += "\"heap\":{\"warning\":" + String(heapWarning ? "true" : "false") + ",";
+    json += "\"warnings\":" + String(heapWarningCount) + ",";
+    json += "\"internalFree\":" + String(heapLatest.internal.freeBytes) + ",";
+    json += "\"internalLargest\":" + String(heapLatest.internal.largestBlock) + ",";
+    json += "\"internalMin\":" + String(heapLatest.internal.minimumFree) + ",";
+    json += "\"psramFree\":" + String(heapLatest.psram.freeBytes) + ",";
+    json += "\"psramLargest\":" + String(heapLatest.psram.largestBlock) + ",";
+    json += "\"psramMin\":" + String(heapLatest.psram.minimumFree) + ",";
+    json += "\"jpegBuffers\":" + String(allocStats.jpegBuffers) + ",";
+    json += "\"jpegBytes\":" + String(allocStats.jpegBytes) + ",";
+    json += "\"jpegFailures\":" + String(allocStats.jpegFailures) + ",";
+    json += "\"statusResponses\":" + String(allocStats.statusResponses) + ",";
+    json += "\"statusBytes\":" + String(allocStats.statusBytes) + ",";
+    json += "\"pageResponses\":" + String(allocStats.pageResponses) + ",";
+    json += "\"pageBytes\":" + String(allocStats.pageBytes) + "},";
+    // Frame pipeline accounting
+    json += "\"frames\":{\"captured\":" + String(frameStats.captured) + ",";
+    json += "\"fetched\":" + String(frameStats.fetched) + ",";
+    json += "\"processed\":" + String(frameStats.processed) + ",";
+    json += "\"droppedGrab\":" + String(frameStats.droppedGrab) + ",";
+    json += "\"droppedCapture\":" + String(frameStats.droppedCapture) + ",";
+    json += "\"droppedFormat\":" + String(frameStats.droppedFormat) + ",";
+    json += "\"droppedEncode\":" + String(frameStats.droppedEncode) + ",";
+    json += "\"staleServed\":" + String(frameStats.staleServed) + ",";
+    json += "\"sensorPeriodUs\":" + String(sensorFramePeriodUs) + ",";
+    json += "\"servedIntervalUs\":" + String(servedIntervalUs) + ",";
+    json += "\"ageUs\":" + String(lastFrameAgeUs) + "},";
+    // Field boundary: flagged sides (bit 0 top, 1 bottom, 2 left, 3 right)
+    json += "\"boundarySides\":" + String(boundarySides) + ",";
+    json += "\"boundaryOffField\":[" + String(boundaryOffField[0]) + "," + String(boundaryOffField[1]) + "," +
+            String(boundaryOffField[2]) + "," + String(boundaryOffField[3]) + "],";
+    json += "\"boundaryEvents\":" + String(boundaryEventCount) + ",";
+    json += "\"boundaryEventFrame\":" + String(boundaryEventFrame) + ",";
+    json += "\"fieldLevel\":" + String(fieldLevel) + ",";
+    json += "\"lineWidths\":[" + String(scanlineLineWidths[0]) + "," + String(scanlineLineWidths[1]) + "," +
+            String(scanlineLineWidths[2]) + "," + String(scanlineLineWidths[3]) + "],";
+    // Outcome counters per scanline: [WHITE, BLACK, CROSSED, UNDEFINED]
+    json += "\"rowStats\":[";
+    for (int i = 0; i < 4; i++) {
+      if (i > 0) json += ",";
+      json += "[" + String(scanlineStateCounts[i][SCANLINE_WHITE]) + "," + String(scanlineStateCounts[i][SCANLINE_BLACK]) + "," +
+              String(scanlineStateCounts[i][SCANLINE_CROSSED]) + "," + String(scanlineStateCounts[i][SCANLINE_UNDEFINED]) + "]";
+    }
+    json += "],";
+    json += "\"laneMode\":" + String(laneModeEnabled ? "true" : "false") + ",";
+    json += "\"laneWidth\":" + String(laneWidthBottom) + ",";
+    json += "\"laneBoundaryMissing\":" + String(laneBoundaryMissing ? "true" : "false") + ",";
+    json += "\"colorMode\":" + String(settings.colorMode) + ",";
+    json += "\"colorMarkers\":[";
+    bool firstMarker = true;
+    for (int c = COLOR_NONE + 1; c < COLOR_CLASS_COUNT; c++) {
+      if (!settings.colorMode || colorMarkers[c].centerX < 0) continue;
+      if (!firstMarker) json += ",";
+      firstMarker = false;
+      json += "{\"color\":\"" + String(colorClassNames[c]) + "\",";
+      json += "\"pixels\":" + String(colorMarkers[c].pixelCount) + ",";
+      json += "\"x\":" + String(colorMarkers[c].centerX) + ",";
+      json += "\"y\":" + String(colorMarkers[c].centerY) + "}";
+    }
+    json += "]";
     json += "}";
+    allocStats.statusResponses++;
+    allocStats.statusBytes += json.length();
     request->send(200, "application/json", json);
   });
 }
@@ -1026,10 +5426,32 @@ void setup() {
   Serial.begin(115200);
   Serial.println("\n\nESP32-CAM Line Detector Starting...");
 
+  // Restore saved settings before the camera is configured
+  loadSettings();
+  
   // Initialize camera
   initCamera();
   Serial.println("Camera initialized");
 
+  // Pre-allocate filter buffers (no allocation while streaming)
+  initTemporalFilter();
+  initColorDetection();
+  resetLaneModel();
+  // Arena sized from a real frame; /stream resizes it if the frame size changes
+  camera_fb_t* firstFrame = esp_camera_fb_get();
+  if (firstFrame != NULL) {
+    ensureFrameArena(firstFrame->width, firstFrame->height);
+    esp_camera_fb_return(firstFrame);
+  }
+  resetProfileStats();
+#if LINE_TRACE
+  if (!initTraceRing()) {
+    Serial.println("Trace ring allocation failed, tracing disabled");
+  }
+#endif
+  taskJsonBuffer = (char*)heap_caps_malloc(TASK_JSON_SIZE, MALLOC_CAP_SPIRAM);
+  sampleHeapStats();
+
   // Start WiFi as Access Point
   WiFi.softAP(ssid, password);
   IPAddress IP = WiFi.softAPIP();
@@ -1038,6 +5460,7 @@ void setup() {
   
   // Setup web server routes
   setupRoutes();
+  server.addHandler(&events);
   
   // Start server
   server.begin();
@@ -1047,6 +5470,16 @@ void setup() {
 }
 
 void loop() {
-  // Nothing to do here, server handles everything
+  // The server handles everything; loop samples task and heap statistics
+  // and runs queued self-tests
+  if (millis() - lastTaskSampleMs >= TASK_SAMPLE_PERIOD_MS) {
+    lastTaskSampleMs = millis();
+    sampleTaskStats();
+  }
+  if (millis() - lastHeapSampleMs >= HEAP_SAMPLE_PERIOD_MS) {
+    lastHeapSampleMs = millis();
+    sampleHeapStats();
+  }
+  runPendingSelfTest();
   delay(10);
 }